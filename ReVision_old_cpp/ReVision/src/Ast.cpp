@@ -0,0 +1,187 @@
+#include "Ast.hpp"
+
+namespace ReVision
+{
+	uint32_t AstPool::add(uint8_t kind, uint32_t offset, uint32_t a, uint32_t b, uint32_t c, uint8_t op, uint16_t flags)
+	{
+		assert(nodes.size() < UINT32_MAX);
+		const uint32_t id{ static_cast<uint32_t>(nodes.size()) };
+		nodes.push_back(AstNode{ kind, op, flags, a, b, c });
+		offsets.push_back(offset);
+		return id;
+	}
+	void AstPool::clear()
+	{
+		nodes.clear();
+		offsets.clear();
+		// Index 0 is the null node
+		add(0, 0, 0, 0, 0, 0, 0);
+	}
+
+	Ast::Ast()
+	{
+		lines.init(nullptr, nullptr);
+		clear();
+	}
+	void Ast::clear()
+	{
+		exprs.clear();
+		stmts.clear();
+		decls.clear();
+		typespecs.clear();
+		lists.clear();
+		int_vals.clear();
+		float_vals.clear();
+		file_decls.clear();
+	}
+
+	ExprId Ast::add_int(uint32_t offset, uint64_t val)
+	{
+		int_vals.push_back(val);
+		return add_expr(EXPR_INT, offset, static_cast<uint32_t>(int_vals.size() - 1));
+	}
+	ExprId Ast::add_float(uint32_t offset, double val)
+	{
+		float_vals.push_back(val);
+		return add_expr(EXPR_FLOAT, offset, static_cast<uint32_t>(float_vals.size() - 1));
+	}
+	ListId Ast::add_list(const uint32_t *ids, size_t count)
+	{
+		assert(lists.size() + count < UINT32_MAX);
+		const ListId start{ static_cast<ListId>(lists.size()) };
+		lists.insert(lists.end(), ids, ids + count);
+		return start;
+	}
+
+	size_t Ast::bytes_used() const
+	{
+		size_t bytes{ 0 };
+		for (const AstPool *pool : { &exprs, &stmts, &decls, &typespecs })
+		{
+			bytes += pool->nodes.size() * sizeof(AstNode) + pool->offsets.size() * sizeof(uint32_t);
+		}
+		return bytes + lists.size() * sizeof(uint32_t) + int_vals.size() * sizeof(uint64_t) + float_vals.size() * sizeof(double);
+	}
+
+	static void print_list(const Ast &ast, ListId list, uint32_t count, std::string *out)
+	{
+		for (uint32_t i{ 0 }; i < count; ++i)
+		{
+			*out += ' ';
+			print_expr(ast, ast.list(list)[i], out);
+		}
+	}
+
+	void print_typespec(const Ast &ast, TypespecId type, std::string *out)
+	{
+		const AstNode &node{ ast.typespecs[type] };
+		switch (node.kind)
+		{
+		case TYPESPEC_NAME: *out += intern_str(node.a); break;
+		case TYPESPEC_PTR: *out += "(ptr "; print_typespec(ast, node.a, out); *out += ')'; break;
+		case TYPESPEC_CONST: *out += "(const "; print_typespec(ast, node.a, out); *out += ')'; break;
+		case TYPESPEC_ARRAY:
+			*out += "(array ";
+			print_typespec(ast, node.a, out);
+			if (node.b)
+			{
+				*out += ' ';
+				print_expr(ast, node.b, out);
+			}
+			*out += ')';
+			break;
+		case TYPESPEC_FUNC:
+			*out += "(func (";
+			for (uint32_t i{ 0 }; i < node.b; ++i)
+			{
+				if (i) { *out += ' '; }
+				print_typespec(ast, ast.list(node.a)[i], out);
+			}
+			*out += ')';
+			if (node.c)
+			{
+				*out += ' ';
+				print_typespec(ast, node.c, out);
+			}
+			*out += ')';
+			break;
+		default: *out += "<none>"; break;
+		}
+	}
+
+	void print_expr(const Ast &ast, ExprId expr, std::string *out)
+	{
+		const AstNode &node{ ast.exprs[expr] };
+		char buf[64];
+		switch (node.kind)
+		{
+		case EXPR_INT:
+			std::snprintf(buf, sizeof(buf), "%" PRIu64, ast.int_vals[node.a]);
+			*out += buf;
+			break;
+		case EXPR_FLOAT:
+			std::snprintf(buf, sizeof(buf), "%g", ast.float_vals[node.a]);
+			*out += buf;
+			break;
+		case EXPR_STR: *out += '"'; out->append(intern_str(node.a), intern_len(node.a)); *out += '"'; break;
+		case EXPR_NAME: *out += intern_str(node.a); break;
+		case EXPR_COMPOUND:
+			*out += "(compound ";
+			if (node.a) { print_typespec(ast, node.a, out); }
+			else { *out += "nil"; }
+			print_list(ast, node.b, node.c, out);
+			*out += ')';
+			break;
+		case EXPR_CALL: *out += '('; print_expr(ast, node.a, out); print_list(ast, node.b, node.c, out); *out += ')'; break;
+		case EXPR_INDEX: *out += "(index "; print_expr(ast, node.a, out); *out += ' '; print_expr(ast, node.b, out); *out += ')'; break;
+		case EXPR_FIELD: *out += "(field "; print_expr(ast, node.a, out); *out += ' '; *out += intern_str(node.b); *out += ')'; break;
+		case EXPR_UNARY:
+		case EXPR_MODIFY:
+			*out += '(';
+			*out += token_kind_name(token_cast(node.op));
+			*out += (node.flags & AST_POSTFIX) ? " post " : " ";
+			print_expr(ast, node.a, out);
+			*out += ')';
+			break;
+		case EXPR_BINARY:
+			*out += '(';
+			*out += token_kind_name(token_cast(node.op));
+			*out += ' ';
+			print_expr(ast, node.a, out);
+			*out += ' ';
+			print_expr(ast, node.b, out);
+			*out += ')';
+			break;
+		case EXPR_TERNARY:
+			*out += "(? ";
+			print_expr(ast, node.a, out);
+			*out += ' ';
+			print_expr(ast, node.b, out);
+			*out += ' ';
+			print_expr(ast, node.c, out);
+			*out += ')';
+			break;
+		case EXPR_SIZEOF_EXPR: *out += "(sizeof "; print_expr(ast, node.a, out); *out += ')'; break;
+		case EXPR_SIZEOF_TYPE: *out += "(sizeof :"; print_typespec(ast, node.a, out); *out += ')'; break;
+		case EXPR_ALIGNOF_EXPR: *out += "(alignof "; print_expr(ast, node.a, out); *out += ')'; break;
+		case EXPR_ALIGNOF_TYPE: *out += "(alignof :"; print_typespec(ast, node.a, out); *out += ')'; break;
+		case EXPR_TYPEOF_EXPR: *out += "(typeof "; print_expr(ast, node.a, out); *out += ')'; break;
+		case EXPR_TYPEOF_TYPE: *out += "(typeof :"; print_typespec(ast, node.a, out); *out += ')'; break;
+		case EXPR_OFFSETOF:
+			*out += "(offsetof ";
+			print_typespec(ast, node.a, out);
+			*out += ' ';
+			*out += intern_str(node.b);
+			*out += ')';
+			break;
+		default: *out += "<none>"; break;
+		}
+	}
+
+	std::string expr_to_string(const Ast &ast, ExprId expr)
+	{
+		std::string out;
+		print_expr(ast, expr, &out);
+		return out;
+	}
+}
\ No newline at end of file
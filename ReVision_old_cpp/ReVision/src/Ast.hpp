@@ -3,5 +3,163 @@
 
 namespace ReVision
 {
-	
+	// The AST of one file lives in a handful of flat pools, one per node category.
+	// Nodes refer to each other by 32-bit index, index 0 of every pool is a null
+	// node so an absent child is simply 0. Variable length children (call arguments,
+	// block statements, struct fields, ...) are runs in the shared lists array.
+	// Nothing points into the pools, so they can grow, be written to disk as they
+	// are, and be thrown away in one clear() that keeps their capacity.
+	typedef uint32_t ExprId;
+	typedef uint32_t StmtId;
+	typedef uint32_t DeclId;
+	typedef uint32_t TypespecId;
+	typedef uint32_t ListId;
+	#define NULL_AST_ID 0
+
+	enum ExprKind : uint8_t
+	{
+		EXPR_NONE,
+		EXPR_INT, // a: int_vals index
+		EXPR_FLOAT, // a: float_vals index
+		EXPR_STR, // a: InternId
+		EXPR_NAME, // a: InternId
+		EXPR_COMPOUND, // a: typespec, b: list of exprs, c: count
+		EXPR_CALL, // a: callee, b: list of args, c: count
+		EXPR_INDEX, // a: expr, b: index
+		EXPR_FIELD, // a: expr, b: InternId
+		EXPR_UNARY, // op, a: operand
+		EXPR_BINARY, // op, a: left, b: right
+		EXPR_TERNARY, // a: cond, b: then, c: else
+		EXPR_MODIFY, // op INC or DEC, flags AST_POSTFIX, a: operand
+		EXPR_SIZEOF_EXPR, // a: expr
+		EXPR_SIZEOF_TYPE, // a: typespec
+		EXPR_ALIGNOF_EXPR, // a: expr
+		EXPR_ALIGNOF_TYPE, // a: typespec
+		EXPR_TYPEOF_EXPR, // a: expr
+		EXPR_TYPEOF_TYPE, // a: typespec
+		EXPR_OFFSETOF, // a: typespec, b: InternId
+	};
+
+	enum TypespecKind : uint8_t
+	{
+		TYPESPEC_NONE,
+		TYPESPEC_NAME, // a: InternId
+		TYPESPEC_PTR, // a: base
+		TYPESPEC_CONST, // a: base
+		TYPESPEC_ARRAY, // a: base, b: size expr or 0
+		TYPESPEC_FUNC, // a: list of param typespecs, b: count, c: return typespec or 0
+	};
+
+	enum StmtKind : uint8_t
+	{
+		STMT_NONE,
+		STMT_BLOCK, // a: list of stmts, b: count
+		STMT_EXPR, // a: expr
+		STMT_ASSIGN, // op, a: left, b: right
+		STMT_INIT, // a: InternId, b: typespec or 0, c: expr or 0
+		STMT_DECL, // a: decl
+		STMT_RETURN, // a: expr or 0
+		STMT_BREAK,
+		STMT_CONTINUE,
+		STMT_JMP, // a: InternId of the label
+		STMT_LABEL, // a: InternId
+		STMT_IF, // a: cond, b: then stmt, c: else stmt or 0
+		STMT_WHILE, // a: cond, b: body
+		STMT_DO_WHILE, // a: cond, b: body
+		STMT_FOR, // a: list of init stmt, cond expr, next stmt and body, any but the body may be 0
+		STMT_SWITCH, // a: expr, b: list of STMT_CASE, c: count
+		STMT_CASE, // flags AST_DEFAULT, a: list of exprs, b: count, c: body block
+	};
+
+	enum DeclKind : uint8_t
+	{
+		DECL_NONE,
+		DECL_CONST, // a: InternId, b: typespec or 0, c: expr
+		DECL_VAR, // a: InternId, b: typespec or 0, c: expr or 0
+		DECL_TYPEDEF, // a: InternId, b: typespec
+		DECL_STRUCT, // a: InternId, b: list of (InternId, typespec) fields, c: field count
+		DECL_UNION, // same as DECL_STRUCT
+		DECL_ENUM, // a: InternId or INVALID_INTERN_ID, b: list of (InternId, expr or 0) items, c: item count
+		DECL_FUNC, // flags AST_VARIADIC, a: InternId, b: list of return typespec or 0, body or 0,
+		           // param count, then (InternId, typespec) params
+		DECL_IMPORT, // a: list of InternIds of the dotted path, b: count
+	};
+
+	#define AST_POSTFIX (1 << 0)
+	#define AST_DEFAULT (1 << 1)
+	#define AST_VARIADIC (1 << 2)
+
+	// 16 bytes for every node of every category. op holds the Token::Kind of
+	// operators, the meaning of a, b and c depends on the kind as listed above.
+	struct AstNode
+	{
+		uint8_t kind;
+		uint8_t op;
+		uint16_t flags;
+		uint32_t a;
+		uint32_t b;
+		uint32_t c;
+	};
+
+	struct AstPool
+	{
+		std::vector<AstNode> nodes;
+		// Byte offset of the token each node starts at, resolved through Ast::lines
+		std::vector<uint32_t> offsets;
+
+		size_t size() const { return nodes.size(); }
+		const AstNode &operator[](uint32_t id) const { return nodes[id]; }
+		uint32_t add(uint8_t kind, uint32_t offset, uint32_t a, uint32_t b, uint32_t c, uint8_t op, uint16_t flags);
+		void clear();
+	};
+
+	struct Ast
+	{
+		LineTable lines;
+		AstPool exprs;
+		AstPool stmts;
+		AstPool decls;
+		AstPool typespecs;
+		std::vector<uint32_t> lists;
+		std::vector<uint64_t> int_vals;
+		std::vector<double> float_vals;
+		// Top level declarations in source order
+		std::vector<DeclId> file_decls;
+
+		Ast();
+		// Drops every node but keeps the memory for the next file.
+		void clear();
+
+		ExprId add_expr(ExprKind kind, uint32_t offset, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint8_t op = 0, uint16_t flags = 0)
+		{
+			return exprs.add(kind, offset, a, b, c, op, flags);
+		}
+		StmtId add_stmt(StmtKind kind, uint32_t offset, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint8_t op = 0, uint16_t flags = 0)
+		{
+			return stmts.add(kind, offset, a, b, c, op, flags);
+		}
+		DeclId add_decl(DeclKind kind, uint32_t offset, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint16_t flags = 0)
+		{
+			return decls.add(kind, offset, a, b, c, 0, flags);
+		}
+		TypespecId add_typespec(TypespecKind kind, uint32_t offset, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0)
+		{
+			return typespecs.add(kind, offset, a, b, c, 0, 0);
+		}
+		ExprId add_int(uint32_t offset, uint64_t val);
+		ExprId add_float(uint32_t offset, double val);
+		// Copies count ids into lists and returns where they start.
+		ListId add_list(const uint32_t *ids, size_t count);
+		const uint32_t *list(ListId start) const { return lists.data() + start; }
+		SrcLoc loc(const AstPool &pool, uint32_t id) const { return lines.resolve(pool.offsets[id]); }
+
+		// Bytes held by the pools, for statistics.
+		size_t bytes_used() const;
+	};
+
+	// S-expression dumps for tests and debugging, e.g. (+ a (* b 2)). They recurse
+	// along the tree, so they are not meant for pathologically deep input.
+	void print_typespec(const Ast &ast, TypespecId type, std::string *out);
+	void print_expr(const Ast &ast, ExprId expr, std::string *out);
+	std::string expr_to_string(const Ast &ast, ExprId expr);
 }
\ No newline at end of file
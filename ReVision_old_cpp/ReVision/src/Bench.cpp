@@ -0,0 +1,674 @@
+#include "Bench.hpp"
+#include "Parse.hpp"
+
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Set REVISION_BENCH_HEAP_COUNT to 1 in a build used only for benchmarking to count every
+// C++ heap allocation in allocs/MB. It replaces the global operator new for the whole
+// process, so the default build leaves it out and counts string arena blocks only.
+#ifndef REVISION_BENCH_HEAP_COUNT
+#define REVISION_BENCH_HEAP_COUNT 0
+#endif
+
+#if REVISION_BENCH_HEAP_COUNT
+#include <atomic>
+#include <new>
+
+static std::atomic<uint64_t> num_heap_allocations{ 0 };
+
+// GCC flags the free below as mismatched with the replaced operator new it cannot see through.
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t size)
+{
+	num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr{ std::malloc(size ? size : 1) })
+	{
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static uint64_t heap_allocation_count() { return num_heap_allocations.load(); }
+#else
+static uint64_t heap_allocation_count() { return 0; }
+#endif
+
+namespace ReVision
+{
+	#define BENCH_RUNS 5
+
+	static uint64_t xorshift64(uint64_t *state)
+	{
+		uint64_t x{ *state };
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		*state = x;
+		return x;
+	}
+
+	// Runs f BENCH_RUNS times and returns the fastest run in seconds
+	template<typename F>
+	static double best_of(F f)
+	{
+		double best{ 1e30 };
+		for (int run{ 0 }; run < BENCH_RUNS; ++run)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			f();
+			best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		}
+		return std::max(best, 1e-9);
+	}
+
+	std::string numeric_corpus(size_t num_literals, uint64_t seed)
+	{
+		std::string text;
+		char buf[64];
+		for (size_t i{ 0 }; i < num_literals; ++i)
+		{
+			const uint64_t r{ xorshift64(&seed) };
+			switch (r % 8)
+			{
+			case 0:
+				std::snprintf(buf, sizeof(buf), "%" PRIu64, (r >> 8) % 100000);
+				break;
+			case 1:
+				std::snprintf(buf, sizeof(buf), "%.17g", static_cast<double>(r >> 11) * 0x1.0p-53 * 1e6);
+				break;
+			case 2:
+				std::snprintf(buf, sizeof(buf), "%.6e", static_cast<double>(r >> 11) * 0x1.0p-53 * 1e30);
+				break;
+			default:
+				std::snprintf(buf, sizeof(buf), "%.*f", static_cast<int>((r >> 4) % 6) + 1, static_cast<double>((r >> 16) % 10000000) / 100.0);
+				break;
+			}
+			text += buf;
+			text += (i % 8 == 7) ? "\n" : ", ";
+		}
+		return text;
+	}
+
+	void bench_float_literals()
+	{
+		const std::string corpus{ numeric_corpus(1 << 20, 0x2545F4914F6CDD1Dull) };
+
+		// Pull out the float literals once so both parsers see exactly the same input
+		std::vector<const char *> floats;
+		std::vector<const char *> int_ends;
+		for (const char *p{ corpus.c_str() }; *p; )
+		{
+			if (!is_digit_char(*p))
+			{
+				++p;
+				continue;
+			}
+			const char *int_end{ scan_kernels.skip_digits(p) };
+			if (*int_end == '.' || to_lower_char(*int_end) == 'e')
+			{
+				floats.push_back(p);
+				int_ends.push_back(int_end);
+				p = parse_float_literal(p, int_end).end;
+			}
+			else
+			{
+				p = int_end;
+			}
+		}
+
+		double sink{ 0.0 };
+		const double strtod_seconds{ best_of([&]()
+		{
+			for (const char *p : floats)
+			{
+				sink += std::strtod(p, nullptr);
+			}
+		}) };
+		const double parse_seconds{ best_of([&]()
+		{
+			for (size_t i{ 0 }; i < floats.size(); ++i)
+			{
+				sink += parse_float_literal(floats[i], int_ends[i]).val;
+			}
+		}) };
+
+		init_keywords();
+		Lexer lexer;
+		TokenBuffer tokens;
+		const double lex_seconds{ best_of([&]()
+		{
+			tokenize_all(&lexer, "<bench>", corpus.c_str(), &tokens);
+		}) };
+
+		const double num_floats{ static_cast<double>(floats.size()) };
+		std::printf("float literals: %zu (%zu bytes of corpus), checksum %g\n", floats.size(), corpus.size(), sink);
+		std::printf("  strtod:              %8.2f ns/literal\n", strtod_seconds * 1e9 / num_floats);
+		std::printf("  parse_float_literal: %8.2f ns/literal (%.2fx)\n", parse_seconds * 1e9 / num_floats, strtod_seconds / parse_seconds);
+		std::printf("  tokenize_all:        %8.2f MB/s, %.0f tokens/s\n",
+			static_cast<double>(corpus.size()) / (1024.0 * 1024.0) / lex_seconds,
+			static_cast<double>(tokens.size()) / lex_seconds);
+	}
+
+	void bench_arenas()
+	{
+		#define BENCH_ARENA_STRINGS (4 * 1024 * 1024)
+		uint64_t seed{ 0x9E3779B97F4A7C15ull };
+		std::vector<uint32_t> lens(BENCH_ARENA_STRINGS);
+		for (uint32_t &len : lens)
+		{
+			len = static_cast<uint32_t>(4 + xorshift64(&seed) % 32);
+		}
+		const char fill[64]{ "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_" };
+
+		std::printf("arenas: %d strings of 4-35 bytes\n", BENCH_ARENA_STRINGS);
+		for (int reserved{ 0 }; reserved < 2; ++reserved)
+		{
+			std::vector<const char *> strs(lens.size());
+			ArenaStats stats{};
+			bool ok{ true };
+			// Fill like str_intern does, a fresh arena every run so the block arena pays for its mallocs
+			const double alloc_seconds{ best_of([&]()
+			{
+				Arena arena;
+				ok = !reserved || arena_init_reserved(&arena, 1024 * 1024 * 1024);
+				for (size_t i{ 0 }; i < lens.size(); ++i)
+				{
+					char *str{ static_cast<char *>(arena_alloc(&arena, lens[i] + 1)) };
+					std::memcpy(str, fill, lens[i]);
+					str[lens[i]] = 0;
+					strs[i] = str;
+				}
+				stats = arena_stats(&arena);
+				arena_free(&arena);
+			}) };
+			if (!ok)
+			{
+				std::printf("  reserved: could not reserve address space\n");
+				continue;
+			}
+
+			// Then walk them in a scattered order, where the page size shows up in TLB misses
+			Arena arena;
+			if (reserved) { arena_init_reserved(&arena, 1024 * 1024 * 1024); }
+			for (size_t i{ 0 }; i < lens.size(); ++i)
+			{
+				char *str{ static_cast<char *>(arena_alloc(&arena, lens[i] + 1)) };
+				std::memcpy(str, fill, lens[i]);
+				str[lens[i]] = 0;
+				strs[i] = str;
+			}
+			uint64_t order_seed{ 0x2545F4914F6CDD1Dull };
+			for (size_t i{ strs.size() - 1 }; i > 0; --i)
+			{
+				std::swap(strs[i], strs[xorshift64(&order_seed) % (i + 1)]);
+			}
+			size_t sink{ 0 };
+			const double walk_seconds{ best_of([&]()
+			{
+				for (const char *str : strs)
+				{
+					sink += static_cast<size_t>(str[0]) + static_cast<size_t>(str[3]);
+				}
+			}) };
+			arena_free(&arena);
+
+			std::printf("  %-8s alloc %6.2f ns/string, scattered walk %6.2f ns/string, %zu blocks, %.1f MB reserved (checksum %zu)\n",
+				reserved ? "reserved" : "blocks",
+				alloc_seconds * 1e9 / static_cast<double>(lens.size()), walk_seconds * 1e9 / static_cast<double>(strs.size()),
+				stats.num_blocks, static_cast<double>(stats.bytes_reserved) / (1024.0 * 1024.0), sink);
+		}
+	}
+
+	void bench_expressions()
+	{
+		#define BENCH_EXPR_SIZE (1 << 20)
+		struct ExprCorpus
+		{
+			const char *name;
+			std::string text;
+		};
+		ExprCorpus corpora[4]{ { "long chain", "" }, { "nested parens", "" }, { "nested calls", "" }, { "nested ternaries", "" } };
+
+		const char *ops[]{ " + ", " * ", " - ", " << ", " == ", " && ", " / ", " | " };
+		uint64_t seed{ 0x9E3779B97F4A7C15ull };
+		for (int i{ 0 }; i < BENCH_EXPR_SIZE; ++i)
+		{
+			if (i) { corpora[0].text += ops[xorshift64(&seed) % 8]; }
+			corpora[0].text += (i % 3) ? "x" : "42";
+		}
+		for (int i{ 0 }; i < BENCH_EXPR_SIZE; ++i) { corpora[1].text += "-("; }
+		corpora[1].text += 'x';
+		corpora[1].text.append(BENCH_EXPR_SIZE, ')');
+		for (int i{ 0 }; i < BENCH_EXPR_SIZE / 2; ++i) { corpora[2].text += "f(x, "; }
+		corpora[2].text += 'y';
+		corpora[2].text.append(BENCH_EXPR_SIZE / 2, ')');
+		for (int i{ 0 }; i < BENCH_EXPR_SIZE / 2; ++i) { corpora[3].text += "a < b ? c : "; }
+		corpora[3].text += 'd';
+
+		init_keywords();
+		Parser parser;
+		Ast ast;
+		std::printf("expressions:\n");
+		for (const ExprCorpus &corpus : corpora)
+		{
+			const double seconds{ best_of([&]()
+			{
+				parse_expr_str(&parser, corpus.text.c_str(), &ast);
+			}) };
+			std::printf("  %-16s %8.2f MB/s, %6.1f M nodes/s, %zu nodes in %.1f KB\n", corpus.name,
+				static_cast<double>(corpus.text.size()) / (1024.0 * 1024.0) / seconds,
+				static_cast<double>(ast.exprs.size()) / seconds / 1e6, ast.exprs.size(),
+				static_cast<double>(ast.bytes_used()) / 1024.0);
+		}
+	}
+
+	std::string program_corpus(size_t num_funcs, uint64_t seed)
+	{
+		std::string text{ "import std.io;\n\nstruct Vec2 { x, y: float; }\n\n" };
+		char buf[512];
+		for (size_t i{ 0 }; i < num_funcs; ++i)
+		{
+			const uint64_t r{ xorshift64(&seed) };
+			std::snprintf(buf, sizeof(buf),
+				"func f%zu(v: Vec2*, n: int): float\n"
+				"{\n"
+				"\ttotal: float = %" PRIu64 ".5;\n"
+				"\tfor (i := 0; i < n; i++)\n"
+				"\t{\n"
+				"\t\tif (v[i].x > total && i %% %d == 0) { total += v[i].x * v[i].y; }\n"
+				"\t\telse { total -= f%zu(v, n - 1) / 2.0; }\n"
+				"\t}\n"
+				"\tswitch (n) { case 0, 1: return total; default: break; }\n"
+				"\treturn total < 0.0 ? -total : total;\n"
+				"}\n\n",
+				i, r % 1000, static_cast<int>(r % 7) + 2, i / 2);
+			text += buf;
+		}
+		return text;
+	}
+
+	void bench_parser()
+	{
+		const std::string corpus{ program_corpus(20000, 0x2545F4914F6CDD1Dull) };
+		const size_t num_lines{ static_cast<size_t>(std::count(corpus.begin(), corpus.end(), '\n')) };
+
+		init_keywords();
+		Lexer lexer;
+		TokenBuffer tokens;
+		const double lex_seconds{ best_of([&]()
+		{
+			tokenize_all(&lexer, "<bench>", corpus.c_str(), &tokens);
+		}) };
+		Parser parser;
+		Ast ast;
+		const double parse_seconds{ best_of([&]()
+		{
+			parse_file(&parser, "<bench>", corpus.c_str(), &ast);
+		}) };
+
+		const double lines_per_second{ static_cast<double>(num_lines) / parse_seconds };
+		std::printf("parser: %zu lines, %zu bytes, %zu tokens\n", num_lines, corpus.size(), tokens.size());
+		std::printf("  lex only:        %8.2f MB/s, %6.2f M lines/s\n",
+			static_cast<double>(corpus.size()) / (1024.0 * 1024.0) / lex_seconds, static_cast<double>(num_lines) / lex_seconds / 1e6);
+		std::printf("  lex and parse:   %8.2f MB/s, %6.2f M lines/s (target %.2f M lines/s, %s)\n",
+			static_cast<double>(corpus.size()) / (1024.0 * 1024.0) / parse_seconds, lines_per_second / 1e6,
+			PARSER_TARGET_LINES_PER_SECOND / 1e6, lines_per_second >= PARSER_TARGET_LINES_PER_SECOND ? "met" : "missed");
+		std::printf("  ast:             %zu exprs, %zu stmts, %zu decls, %.1f KB\n",
+			ast.exprs.size(), ast.stmts.size(), ast.decls.size(), static_cast<double>(ast.bytes_used()) / 1024.0);
+	}
+
+	const char *corpus_mix_names[NUM_CORPUS_MIXES]{ "ident", "comment", "literal", "nested_comment", "mixed" };
+
+	static const char *const bench_words[]{
+		"x", "i", "len", "count", "buffer", "node_index", "parse_expression", "TokenBuffer", "str_intern_range",
+		"very_long_identifier_name_for_testing", "func", "return", "if", "while", "struct", "const", "sizeof",
+	};
+
+	static void append_word(std::string *text, uint64_t r)
+	{
+		*text += bench_words[r % (sizeof(bench_words) / sizeof(bench_words[0]))];
+		// A numbered suffix on half of them keeps the interner inserting as the corpus grows
+		if ((r >> 8) & 1)
+		{
+			*text += '_';
+			*text += std::to_string((r >> 9) % 4096);
+		}
+	}
+
+	static void append_code_line(std::string *text, uint64_t *seed)
+	{
+		const uint64_t r{ xorshift64(seed) };
+		append_word(text, r);
+		*text += " = ";
+		append_word(text, r >> 13);
+		*text += (r & 1) ? " + " : " * ";
+		append_word(text, r >> 26);
+		*text += '(';
+		append_word(text, r >> 39);
+		*text += ");\n";
+	}
+
+	static void append_literal_line(std::string *text, uint64_t *seed)
+	{
+		const uint64_t r{ xorshift64(seed) };
+		char buf[160];
+		std::snprintf(buf, sizeof(buf), "t = { %" PRIu64 ", 0x%" PRIx64 ", %" PRIu64 ".%03d, \"str %" PRIu64 "\\n\", '%c', 0b101, 1e%d };\n",
+			r % 100000, r >> 20, (r >> 8) % 1000, static_cast<int>(r % 1000), r % 97, static_cast<char>('a' + r % 26), static_cast<int>(r % 30));
+		*text += buf;
+	}
+
+	std::string generate_corpus(CorpusMix mix, size_t num_bytes, uint64_t seed)
+	{
+		std::string text;
+		text.reserve(num_bytes + 256);
+		while (text.size() < num_bytes)
+		{
+			const uint64_t r{ xorshift64(&seed) };
+			switch (mix)
+			{
+			case CORPUS_IDENT:
+				append_code_line(&text, &seed);
+				break;
+			case CORPUS_COMMENT:
+				if (r % 4 == 0) { append_code_line(&text, &seed); }
+				else if (r % 4 == 1) { text += "/* block comment spanning\n   two lines with some words in it */\n"; }
+				else { text += "// a line comment explaining the code below in some detail\n"; }
+				break;
+			case CORPUS_LITERAL:
+				append_literal_line(&text, &seed);
+				break;
+			case CORPUS_NESTED_COMMENT:
+			{
+				const int depth{ static_cast<int>(r % 16) + 1 };
+				for (int i{ 0 }; i < depth; ++i) { text += "/* level\n"; }
+				text += "innermost text * / with stray delimiters /";
+				for (int i{ 0 }; i < depth; ++i) { text += " */"; }
+				text += '\n';
+				append_code_line(&text, &seed);
+				break;
+			}
+			case CORPUS_MIXED:
+				if (r % 8 < 5) { append_code_line(&text, &seed); }
+				else if (r % 8 < 7) { append_literal_line(&text, &seed); }
+				else { text += "// comment\n"; }
+				break;
+			default:
+				assert(0);
+				break;
+			}
+		}
+		return text;
+	}
+
+	size_t peak_memory_bytes()
+	{
+	#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return 0;
+		}
+		return counters.PeakWorkingSetSize;
+	#else
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+	#ifdef __APPLE__
+		return static_cast<size_t>(usage.ru_maxrss);
+	#else
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+	#endif
+	#endif
+	}
+
+	// Swaps in an empty interner and string arena for as long as it lives, so every
+	// corpus mix starts as cold as in a fresh process whatever ran before it. The
+	// process's own interns are put back untouched, the mix's are freed.
+	struct ScopedBenchInterns
+	{
+		Arena arena;
+		std::vector<InternStr> strs;
+		std::vector<InternSlot> slots;
+
+		ScopedBenchInterns()
+		{
+			swap();
+			init_interns();
+		}
+		~ScopedBenchInterns()
+		{
+			swap();
+			arena_free(&arena);
+		}
+		void swap()
+		{
+			std::swap(arena, str_arena);
+			std::swap(strs, interns);
+			std::swap(slots, intern_slots);
+		}
+	};
+
+	LexBenchResult bench_lex_corpus(CorpusMix mix, size_t num_bytes, uint64_t seed)
+	{
+		LexBenchResult result{};
+		result.mix = mix;
+		const std::string corpus{ generate_corpus(mix, num_bytes, seed) };
+		result.num_bytes = corpus.size();
+		init_keywords();
+		const ScopedBenchInterns scoped_interns;
+
+		// One untimed run for the counts, while every name is still new to the interner
+		Lexer lexer;
+		const size_t interns_before{ interns.size() };
+		const size_t blocks_before{ arena_stats(&str_arena).num_blocks };
+		const uint64_t allocations_before{ heap_allocation_count() };
+		lexer.init_stream("<bench>", corpus.c_str());
+		while (!lexer.is_token(Token::END_OF_FILE))
+		{
+			lexer.next_token();
+		}
+		result.num_allocations = heap_allocation_count() - allocations_before + arena_stats(&str_arena).num_blocks - blocks_before;
+		result.num_intern_inserts = interns.size() - interns_before;
+
+		// next_token, interning included as it happens while lexing
+		result.lex_seconds = best_of([&]()
+		{
+			result.num_tokens = 0;
+			lexer.init_stream("<bench>", corpus.c_str());
+			while (!lexer.is_token(Token::END_OF_FILE))
+			{
+				++result.num_tokens;
+				lexer.next_token();
+			}
+		});
+
+		// str_intern_range alone, over the name ranges the lexer found
+		std::vector<const char *> starts, ends;
+		lexer.init_stream("<bench>", corpus.c_str());
+		while (!lexer.is_token(Token::END_OF_FILE))
+		{
+			if (lexer.is_token(Token::NAME) || lexer.is_token(Token::KEYWORD))
+			{
+				starts.push_back(lexer.token.start);
+				ends.push_back(lexer.token.end);
+			}
+			lexer.next_token();
+		}
+		result.num_intern_calls = starts.size();
+		size_t sink{ 0 };
+		result.intern_seconds = best_of([&]()
+		{
+			for (size_t i{ 0 }; i < starts.size(); ++i)
+			{
+				sink += reinterpret_cast<uintptr_t>(str_intern_range(starts[i], ends[i]));
+			}
+		});
+
+		// arena_alloc with the same sizes the interner asks for
+		result.arena_seconds = best_of([&]()
+		{
+			Arena arena;
+			for (size_t i{ 0 }; i < starts.size(); ++i)
+			{
+				sink += reinterpret_cast<uintptr_t>(arena_alloc(&arena, sizeof(InternId) + static_cast<size_t>(ends[i] - starts[i]) + 1));
+			}
+			arena_free(&arena);
+		});
+		result.sink = sink;
+		result.intern_memory = arena_stats(&str_arena).bytes_reserved
+			+ interns.capacity() * sizeof(InternStr) + intern_slots.capacity() * sizeof(InternSlot);
+		return result;
+	}
+
+	static double per_second(size_t count, double seconds)
+	{
+		return static_cast<double>(count) / std::max(seconds, 1e-9);
+	}
+
+	void print_lex_bench_json(FILE *file, const std::vector<LexBenchResult> &results, uint64_t seed)
+	{
+		std::fprintf(file, "{\n  \"seed\": %" PRIu64 ",\n  \"scan_kernels\": \"%s\",\n  \"peak_memory_bytes\": %zu,\n  \"results\": [\n",
+			seed, scan_kernels.name, peak_memory_bytes());
+		for (size_t i{ 0 }; i < results.size(); ++i)
+		{
+			const LexBenchResult &r{ results[i] };
+			const double mb{ static_cast<double>(r.num_bytes) / (1024.0 * 1024.0) };
+			std::fprintf(file,
+				"    {\n"
+				"      \"mix\": \"%s\",\n"
+				"      \"bytes\": %zu,\n"
+				"      \"tokens\": %zu,\n"
+				"      \"next_token\": { \"mb_per_s\": %.3f, \"tokens_per_s\": %.0f },\n"
+				"      \"str_intern_range\": { \"calls\": %zu, \"inserts\": %zu, \"calls_per_s\": %.0f },\n"
+				"      \"arena_alloc\": { \"calls\": %zu, \"calls_per_s\": %.0f },\n"
+				"      \"allocations_per_mb\": %.3f,\n"
+				"      \"intern_memory_bytes\": %zu\n"
+				"    }%s\n",
+				corpus_mix_names[r.mix], r.num_bytes, r.num_tokens,
+				mb / std::max(r.lex_seconds, 1e-9), per_second(r.num_tokens, r.lex_seconds),
+				r.num_intern_calls, r.num_intern_inserts, per_second(r.num_intern_calls, r.intern_seconds),
+				r.num_intern_calls, per_second(r.num_intern_calls, r.arena_seconds),
+				static_cast<double>(r.num_allocations) / std::max(mb, 1e-9), r.intern_memory,
+				i + 1 < results.size() ? "," : "");
+		}
+		std::fprintf(file, "  ]\n}\n");
+	}
+
+	void print_lex_bench(const std::vector<LexBenchResult> &results)
+	{
+		std::printf("lexer suite (%s kernels%s):\n", scan_kernels.name,
+			REVISION_BENCH_HEAP_COUNT ? "" : ", allocs are string arena blocks only");
+		for (const LexBenchResult &r : results)
+		{
+			const double mb{ static_cast<double>(r.num_bytes) / (1024.0 * 1024.0) };
+			std::printf("  %-15s next_token %8.2f MB/s  str_intern_range %6.1f M/s  arena_alloc %6.1f M/s  %.2f allocs/MB\n",
+				corpus_mix_names[r.mix], mb / std::max(r.lex_seconds, 1e-9),
+				per_second(r.num_intern_calls, r.intern_seconds) / 1e6, per_second(r.num_intern_calls, r.arena_seconds) / 1e6,
+				static_cast<double>(r.num_allocations) / std::max(mb, 1e-9));
+		}
+		std::printf("  peak memory %.1f MB\n", static_cast<double>(peak_memory_bytes()) / (1024.0 * 1024.0));
+	}
+
+	int bench_main(int argc, char **argv)
+	{
+		bool json{ false };
+		size_t num_bytes{ 8 * 1024 * 1024 };
+		uint64_t seed{ 0x9E3779B97F4A7C15ull };
+		const char *out_path{ nullptr };
+		std::vector<CorpusMix> mixes;
+		for (int i{ 0 }; i < argc; ++i)
+		{
+			const char *arg{ argv[i] };
+			if (std::strcmp(arg, "--json") == 0) { json = true; }
+			else if (std::strncmp(arg, "--out=", 6) == 0) { json = true; out_path = arg + 6; }
+			else if (std::strncmp(arg, "--size=", 7) == 0)
+			{
+				const double mb{ std::strtod(arg + 7, nullptr) };
+				if (mb <= 0.0)
+				{
+					std::printf("error: invalid corpus size '%s'\n", arg);
+					return 1;
+				}
+				num_bytes = static_cast<size_t>(mb * 1024.0 * 1024.0);
+			}
+			else if (std::strncmp(arg, "--seed=", 7) == 0) { seed = std::strtoull(arg + 7, nullptr, 0); }
+			else if (std::strncmp(arg, "--mix=", 6) == 0)
+			{
+				size_t mix{ 0 };
+				while (mix < NUM_CORPUS_MIXES && std::strcmp(corpus_mix_names[mix], arg + 6) != 0) { ++mix; }
+				if (mix == NUM_CORPUS_MIXES)
+				{
+					std::printf("error: unknown corpus mix '%s'\n", arg + 6);
+					return 1;
+				}
+				mixes.push_back(static_cast<CorpusMix>(mix));
+			}
+			else
+			{
+				std::printf("error: unknown benchmark option '%s'\n", arg);
+				return 1;
+			}
+		}
+		if (mixes.empty())
+		{
+			for (size_t mix{ 0 }; mix < NUM_CORPUS_MIXES; ++mix) { mixes.push_back(static_cast<CorpusMix>(mix)); }
+		}
+
+		std::vector<LexBenchResult> results;
+		for (CorpusMix mix : mixes)
+		{
+			results.push_back(bench_lex_corpus(mix, num_bytes, seed));
+		}
+		if (json)
+		{
+			FILE *file{ out_path ? std::fopen(out_path, "w") : stdout };
+			if (!file)
+			{
+				std::printf("error: could not write '%s'\n", out_path);
+				return 1;
+			}
+			print_lex_bench_json(file, results, seed);
+			if (out_path) { std::fclose(file); }
+			return 0;
+		}
+
+		print_lex_bench(results);
+		bench_float_literals();
+		bench_arenas();
+		bench_expressions();
+		bench_parser();
+		return 0;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "Common.hpp"
+#include "Float.hpp"
+#include "Lex.hpp"
+
+namespace ReVision
+{
+	// Generates a table of numeric literals, mostly floats, one row of 8 per line.
+	std::string numeric_corpus(size_t num_literals, uint64_t seed);
+
+	// Times parse_float_literal against strtod on the same literals,
+	// then tokenize_all over the whole corpus.
+	void bench_float_literals();
+
+	// Times arena_alloc and a scattered walk over the result for the malloc'd block
+	// backend against the reserved, huge page backed one.
+	void bench_arenas();
+
+	// Parses very long and very deeply nested expressions, the nesting is in
+	// the millions to show the parser doesn't depend on the native stack.
+	void bench_expressions();
+
+	// Generates num_funcs functions of typical statements, 12 lines each.
+	std::string program_corpus(size_t num_funcs, uint64_t seed);
+	// Lexes and parses program_corpus and checks lines per second against the
+	// target documented on Parser.
+	void bench_parser();
+
+	enum CorpusMix
+	{
+		CORPUS_IDENT,
+		CORPUS_COMMENT,
+		CORPUS_LITERAL,
+		CORPUS_NESTED_COMMENT,
+		CORPUS_MIXED,
+		NUM_CORPUS_MIXES,
+	};
+	extern const char *corpus_mix_names[NUM_CORPUS_MIXES];
+
+	// Reproducible synthetic source of at least num_bytes, the same seed always gives the same text.
+	std::string generate_corpus(CorpusMix mix, size_t num_bytes, uint64_t seed);
+
+	struct LexBenchResult
+	{
+		CorpusMix mix;
+		size_t num_bytes;
+		size_t num_tokens;
+		size_t num_intern_calls;
+		size_t num_intern_inserts;
+		// String arena blocks during one lexing run on a cold interner, plus heap
+		// allocations in builds with REVISION_BENCH_HEAP_COUNT
+		size_t num_allocations;
+		// Held by the mix's own interner and string arena at the end, tables included.
+		// Peak memory is only measured for the whole process.
+		size_t intern_memory;
+		double lex_seconds;
+		double intern_seconds;
+		double arena_seconds;
+		size_t sink;
+	};
+
+	// Peak resident memory of the process so far.
+	size_t peak_memory_bytes();
+	// Times next_token over a fresh corpus, then str_intern_range and arena_alloc
+	// on the names it contains. Runs on an interner of its own, empty but for the
+	// keywords, so the results don't depend on what was benchmarked before.
+	LexBenchResult bench_lex_corpus(CorpusMix mix, size_t num_bytes, uint64_t seed);
+	void print_lex_bench(const std::vector<LexBenchResult> &results);
+	void print_lex_bench_json(FILE *file, const std::vector<LexBenchResult> &results, uint64_t seed);
+
+	// Usage: ReVision --bench [--json | --out=file.json] [--size=MB] [--seed=N] [--mix=name]...
+	// Without JSON output the lexer suite is followed by the other benchmarks.
+	int bench_main(int argc, char **argv);
+}
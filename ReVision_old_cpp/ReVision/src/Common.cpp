@@ -1,4 +1,15 @@
 #include "Common.hpp"
+#include "Diag.hpp"
+#include "Stats.hpp"
+#include "Keywords.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 
 namespace ReVision
 {
@@ -37,41 +48,153 @@ namespace ReVision
 	{
 		va_list args;
 		va_start(args, fmt);
-		std::printf("FATAL: ");
-		std::printf(fmt, args);
-		std::printf("\n");
+		report_diag(DIAG_FATAL, fmt, args);
 		va_end(args);
+		flush_diags(stdout);
 		assert(0);
 		exit(1);
 	}
 	void syntax_error(const char *fmt, ...)
 	{
+		++thread_error_count;
 		va_list args;
 		va_start(args, fmt);
-		std::printf("Syntax Error: ");
-		std::printf(fmt, args);
-		std::printf("\n");
+		report_diag(DIAG_ERROR, fmt, args);
 		va_end(args);
 	}
 	void fatal_syntax_error(const char *fmt, ...)
 	{
+		++thread_error_count;
 		va_list args;
 		va_start(args, fmt);
-		std::printf("Syntax Error: ");
-		std::printf(fmt, args);
-		std::printf("\n");
+		report_diag(DIAG_FATAL, fmt, args);
 		va_end(args);
+		flush_diags(stdout);
 		assert(0);
 		exit(1);
 	}
 
-	void arena_grow(Arena *arena, size_t min_size)
+	static char *vm_reserve(size_t size)
+	{
+	#ifdef _WIN32
+		return static_cast<char *>(VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS));
+	#else
+		void *base{ mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) };
+		return base == MAP_FAILED ? nullptr : static_cast<char *>(base);
+	#endif
+	}
+	static bool vm_commit(char *ptr, size_t size)
+	{
+	#ifdef _WIN32
+		return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+	#else
+		return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+	#endif
+	}
+	static void vm_release(char *ptr, size_t size)
+	{
+	#ifdef _WIN32
+		(void)size;
+		VirtualFree(ptr, 0, MEM_RELEASE);
+	#else
+		munmap(ptr, size);
+	#endif
+	}
+
+	bool arena_init_reserved(Arena *arena, size_t reserve_size)
+	{
+		assert(arena->blocks.empty() && !arena->reserve_base);
+		reserve_size = ALIGN_UP(reserve_size, ARENA_COMMIT_SIZE);
+		// Over-reserve by a huge page so the range can start on a huge page boundary
+		char *base{ vm_reserve(reserve_size + ARENA_COMMIT_SIZE) };
+		if (!base)
+		{
+			return false;
+		}
+		char *aligned{ static_cast<char *>(ALIGN_UP_PTR(base, ARENA_COMMIT_SIZE)) };
+	#ifdef _WIN32
+		// Windows can only release a reservation as a whole, keep the slack
+		aligned = base;
+	#else
+		if (aligned != base) { munmap(base, static_cast<size_t>(aligned - base)); }
+		munmap(aligned + reserve_size, static_cast<size_t>(base + ARENA_COMMIT_SIZE - aligned));
+	#endif
+	#ifdef MADV_HUGEPAGE
+		madvise(aligned, reserve_size, MADV_HUGEPAGE);
+	#endif
+		arena->reserve_base = aligned;
+		arena->reserve_size = reserve_size;
+		arena->blocks.push_back(ArenaBlock{ aligned, 0 });
+		return true;
+	}
+
+	// Makes room for min_size more bytes in the reserved block by committing
+	// further into the reservation. Fails once the reservation is used up.
+	static bool arena_grow_reserved(Arena *arena, size_t min_size)
 	{
-		const size_t size{ ALIGN_UP(std::max<size_t>(ARENA_BLOCK_SIZE, min_size), ARENA_ALIGNMENT) };
-		arena->ptr = static_cast<char *>(xmalloc(size));
-		arena->end = arena->ptr + size;
-		arena->blocks.push_back(arena->ptr);
+		size_t i{ 0 };
+		while (arena->blocks[i].base != arena->reserve_base) { ++i; }
+		if (i >= arena->num_used)
+		{
+			// Spare after a reset, start over at its base
+			std::swap(arena->blocks[arena->num_used], arena->blocks[i]);
+			i = arena->num_used++;
+			arena->ptr = arena->reserve_base;
+		}
+		else if (i != arena->num_used - 1)
+		{
+			// Already filled up, the arena moved on to malloc'd blocks
+			return false;
+		}
+
+		ArenaBlock &block{ arena->blocks[i] };
+		const size_t offset{ static_cast<size_t>(arena->ptr - block.base) };
+		if (offset + min_size <= block.size)
+		{
+			arena->end = block.base + block.size;
+			return true;
+		}
+		const size_t committed{ ALIGN_UP(offset + min_size, ARENA_COMMIT_SIZE) };
+		if (committed > arena->reserve_size || !vm_commit(block.base + block.size, committed - block.size))
+		{
+			return false;
+		}
+		STAT_ADD(STAT_ARENA_BYTES, committed - block.size);
+		block.size = committed;
+		arena->end = block.base + block.size;
+		return true;
+	}
 
+	void arena_grow(Arena *arena, size_t min_size)
+	{
+		min_size = ALIGN_UP(min_size, ARENA_ALIGNMENT);
+		if (arena->reserve_base && arena_grow_reserved(arena, min_size))
+		{
+			return;
+		}
+		// Reuse a spare block left behind by a reset if one is big enough.
+		size_t i{ arena->num_used };
+		while (i < arena->blocks.size() && arena->blocks[i].size < min_size)
+		{
+			++i;
+		}
+		if (i < arena->blocks.size())
+		{
+			STAT_INC(STAT_ARENA_REUSED_BLOCKS);
+			std::swap(arena->blocks[arena->num_used], arena->blocks[i]);
+		}
+		else
+		{
+			const size_t shift{ std::min<size_t>(arena->blocks.size(), 16) };
+			const size_t size{ std::max<size_t>(std::min<size_t>(static_cast<size_t>(ARENA_MIN_BLOCK_SIZE) << shift, ARENA_MAX_BLOCK_SIZE), min_size) };
+			STAT_INC(STAT_ARENA_BLOCKS);
+			STAT_ADD(STAT_ARENA_BYTES, size);
+			const ArenaBlock block{ static_cast<char *>(xmalloc(size)), size };
+			arena->blocks.insert(arena->blocks.begin() + static_cast<ptrdiff_t>(arena->num_used), block);
+		}
+		const ArenaBlock &block{ arena->blocks[arena->num_used++] };
+		arena->ptr = block.base;
+		arena->end = block.base + block.size;
 	}
 	void *arena_alloc(Arena *arena, size_t size)
 	{
@@ -82,39 +205,402 @@ namespace ReVision
 		}
 		void *ptr{ arena->ptr };
 		arena->ptr = static_cast<char *>(ALIGN_UP_PTR(arena->ptr + size, ARENA_ALIGNMENT));
+		arena->bytes_used += size;
 		assert(arena->ptr <= arena->end);
 		assert(ptr == ALIGN_DOWN_PTR(ptr, ARENA_ALIGNMENT));
 		return ptr;
 	}
+	ArenaMark arena_mark(const Arena *arena)
+	{
+		return ArenaMark{ arena->num_used, arena->ptr, arena->bytes_used };
+	}
+	void arena_reset_to_mark(Arena *arena, ArenaMark mark)
+	{
+		assert(mark.num_used <= arena->num_used);
+		arena->num_used = mark.num_used;
+		arena->bytes_used = mark.bytes_used;
+		if (mark.num_used == 0)
+		{
+			arena->ptr = nullptr;
+			arena->end = nullptr;
+		}
+		else
+		{
+			const ArenaBlock &block{ arena->blocks[mark.num_used - 1] };
+			assert(block.base <= mark.ptr && mark.ptr <= block.base + block.size);
+			arena->ptr = mark.ptr;
+			arena->end = block.base + block.size;
+		}
+	}
+	void arena_reset(Arena *arena)
+	{
+		arena_reset_to_mark(arena, ArenaMark{ 0, nullptr, 0 });
+	}
+	void arena_move_blocks(Arena *dst, Arena *src)
+	{
+		assert(!src->reserve_base);
+		// The moved blocks go in front of dst's current block, so dst keeps bumping where it left off.
+		const size_t insert_at{ dst->num_used == 0 ? 0 : dst->num_used - 1 };
+		dst->blocks.insert(dst->blocks.begin() + static_cast<ptrdiff_t>(insert_at),
+			src->blocks.begin(), src->blocks.begin() + static_cast<ptrdiff_t>(src->num_used));
+		dst->num_used += src->num_used;
+		dst->bytes_used += src->bytes_used;
+		if (dst->num_used == src->num_used && dst->num_used != 0)
+		{
+			// dst had no current block, continue in the last moved one
+			dst->ptr = src->ptr;
+			dst->end = src->end;
+		}
+		src->blocks.erase(src->blocks.begin(), src->blocks.begin() + static_cast<ptrdiff_t>(src->num_used));
+		src->num_used = 0;
+		arena_reset(src);
+	}
 	void arena_free(Arena *arena)
 	{
-		for (char *c : arena->blocks)
+		for (const ArenaBlock &block : arena->blocks)
+		{
+			if (block.base == arena->reserve_base)
+			{
+				vm_release(block.base, arena->reserve_size);
+			}
+			else
+			{
+				std::free(block.base);
+			}
+		}
+		arena->blocks.clear();
+		arena->reserve_base = nullptr;
+		arena->reserve_size = 0;
+		arena->num_used = 0;
+		arena_reset(arena);
+	}
+	ArenaStats arena_stats(const Arena *arena)
+	{
+		ArenaStats stats{ arena->bytes_used, 0, arena->blocks.size() };
+		for (const ArenaBlock &block : arena->blocks)
+		{
+			stats.bytes_reserved += block.size;
+		}
+		return stats;
+	}
+
+	uint64_t hash_bytes(const void *ptr, size_t len)
+	{
+		// FNV-1a
+		uint64_t x{ 0xcbf29ce484222325ull };
+		const auto *buf = static_cast<const unsigned char *>(ptr);
+		for (size_t i{ 0 }; i < len; ++i)
 		{
-			std::free(c);
+			x ^= buf[i];
+			x *= 0x100000001b3ull;
 		}
+		return x;
+	}
+
+	#define XXH_PRIME64_1 0x9E3779B185EBCA87ull
+	#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4Full
+	#define XXH_PRIME64_3 0x165667B19E3779F9ull
+	#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ull
+	#define XXH_PRIME64_5 0x27D4EB2F165667C5ull
+
+	static inline uint64_t rotl64(uint64_t x, int r)
+	{
+		return (x << r) | (x >> (64 - r));
+	}
+	static inline uint64_t read64(const unsigned char *p)
+	{
+		uint64_t x;
+		std::memcpy(&x, p, sizeof(x));
+		return x;
+	}
+	static inline uint32_t read32(const unsigned char *p)
+	{
+		uint32_t x;
+		std::memcpy(&x, p, sizeof(x));
+		return x;
+	}
+	static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+	{
+		acc += input * XXH_PRIME64_2;
+		return rotl64(acc, 31) * XXH_PRIME64_1;
+	}
+	static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t val)
+	{
+		acc ^= xxh64_round(0, val);
+		return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+
+	uint64_t xxhash64(const void *ptr, size_t len, uint64_t seed)
+	{
+		const auto *p = static_cast<const unsigned char *>(ptr);
+		const unsigned char *const end{ p + len };
+		uint64_t h;
+		if (len >= 32)
+		{
+			uint64_t v1{ seed + XXH_PRIME64_1 + XXH_PRIME64_2 };
+			uint64_t v2{ seed + XXH_PRIME64_2 };
+			uint64_t v3{ seed };
+			uint64_t v4{ seed - XXH_PRIME64_1 };
+			for (; end - p >= 32; p += 32)
+			{
+				v1 = xxh64_round(v1, read64(p));
+				v2 = xxh64_round(v2, read64(p + 8));
+				v3 = xxh64_round(v3, read64(p + 16));
+				v4 = xxh64_round(v4, read64(p + 24));
+			}
+			h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+			h = xxh64_merge_round(h, v1);
+			h = xxh64_merge_round(h, v2);
+			h = xxh64_merge_round(h, v3);
+			h = xxh64_merge_round(h, v4);
+		}
+		else
+		{
+			h = seed + XXH_PRIME64_5;
+		}
+		h += len;
+		for (; end - p >= 8; p += 8)
+		{
+			h ^= xxh64_round(0, read64(p));
+			h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+		}
+		if (end - p >= 4)
+		{
+			h ^= read32(p) * XXH_PRIME64_1;
+			h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+			p += 4;
+		}
+		for (; p < end; ++p)
+		{
+			h ^= *p * XXH_PRIME64_5;
+			h = rotl64(h, 11) * XXH_PRIME64_1;
+		}
+		h ^= h >> 33;
+		h *= XXH_PRIME64_2;
+		h ^= h >> 29;
+		h *= XXH_PRIME64_3;
+		h ^= h >> 32;
+		return h;
 	}
 
 	Arena str_arena;
 	std::vector<InternStr> interns;
+	std::vector<InternSlot> intern_slots;
 
-	const char *str_intern_range(const char *start, const char *end)
+	static void intern_slots_grow(std::vector<InternSlot> *slots, size_t new_cap)
+	{
+		std::vector<InternSlot> old_slots(new_cap, InternSlot{ INVALID_INTERN_ID, 0 });
+		old_slots.swap(*slots);
+		const size_t mask{ new_cap - 1 };
+		for (const InternSlot &slot : old_slots)
+		{
+			if (slot.id == INVALID_INTERN_ID) { continue; }
+			size_t i{ slot.hash & mask };
+			while ((*slots)[i].id != INVALID_INTERN_ID) { i = (i + 1) & mask; }
+			(*slots)[i] = slot;
+		}
+	}
+
+	// Returns the slot holding the string, or the empty slot where it belongs.
+	// ids index strs, local_mask strips the shard bits of provisional ids.
+	static size_t intern_slots_find(const std::vector<InternSlot> &slots, const std::vector<InternStr> &strs, InternId local_mask,
+		const char *start, size_t len, uint64_t hash)
 	{
-		uint64_t len{ static_cast<uint64_t>(end - start) };
-		for (const InternStr &inStr : interns)
+		const size_t mask{ slots.size() - 1 };
+		size_t i{ hash & mask };
+		for (; slots[i].id != INVALID_INTERN_ID; i = (i + 1) & mask)
 		{
-			if (inStr.len == len && std::strncmp(inStr.str, start, len) == 0)
+			if (slots[i].hash != static_cast<uint32_t>(hash)) { continue; }
+			const InternStr &inStr{ strs[slots[i].id & local_mask] };
+			if (inStr.hash == hash && inStr.len == len && std::memcmp(inStr.str, start, len) == 0)
 			{
-				return inStr.str;
+				break;
 			}
 		}
-		auto *str = reinterpret_cast<char*>(arena_alloc(&str_arena, len + 1));
+		STAT_INTERN_PROBE((i - (hash & mask)) & mask);
+		return i;
+	}
+
+	static InternId intern_insert(std::vector<InternSlot> *slots, std::vector<InternStr> *strs, InternId first_id, InternId local_mask,
+		Arena *arena, const char *start, size_t len, uint64_t hash)
+	{
+		if (2 * (strs->size() + 1) > slots->size())
+		{
+			intern_slots_grow(slots, std::max<size_t>(INTERNS_MIN_CAP, 2 * slots->size()));
+		}
+		const size_t i{ intern_slots_find(*slots, *strs, local_mask, start, len, hash) };
+		if ((*slots)[i].id != INVALID_INTERN_ID)
+		{
+			STAT_INC(STAT_INTERN_LOOKUPS);
+			return (*slots)[i].id;
+		}
+		STAT_INC(STAT_INTERN_INSERTS);
+		assert(strs->size() < local_mask);
+		const InternId id{ first_id + static_cast<InternId>(strs->size()) };
+		auto *mem = static_cast<char *>(arena_alloc(arena, sizeof(InternId) + len + 1));
+		std::memcpy(mem, &id, sizeof(InternId));
+		char *str{ mem + sizeof(InternId) };
 		std::memcpy(str, start, len);
 		str[len] = 0;
-		interns.emplace_back(len, const_cast<const char*>(str));
-		return str;
+		strs->emplace_back(len, hash, str);
+		(*slots)[i] = InternSlot{ id, static_cast<uint32_t>(hash) };
+		return id;
+	}
+
+	void init_interns()
+	{
+		if (!interns.empty())
+		{
+			return;
+		}
+		for (uint32_t id{ 0 }; id < NUM_KEYWORDS; ++id)
+		{
+			const char *name{ keyword_names[id] };
+			const size_t len{ keyword_lens[id] };
+			intern_insert(&intern_slots, &interns, 0, INVALID_INTERN_ID, &str_arena, name, len, hash_bytes(name, len));
+		}
+		assert(interns.size() == NUM_KEYWORDS);
+	}
+
+	InternId intern_id_range(const char *start, const char *end)
+	{
+		init_interns();
+		const size_t len{ static_cast<size_t>(end - start) };
+		const InternId id{ intern_insert(&intern_slots, &interns, 0, INVALID_INTERN_ID, &str_arena, start, len, hash_bytes(start, len)) };
+		assert(!is_provisional_intern_id(id));
+		return id;
+	}
+	InternId intern_id(const char *str)
+	{
+		return intern_id_range(str, str + std::strlen(str));
+	}
+	const char *str_intern_range(const char *start, const char *end, InternId *id)
+	{
+		*id = intern_id_range(start, end);
+		return interns[*id].str;
+	}
+	const char *str_intern_range(const char *start, const char *end)
+	{
+		return interns[intern_id_range(start, end)].str;
 	}
 	const char *str_intern(const char *str)
 	{
 		return str_intern_range(str, str + std::strlen(str));
 	}
+
+	InternShard intern_shards[NUM_INTERN_SHARDS];
+
+	const char *str_intern_range_concurrent(const char *start, const char *end, InternId *id)
+	{
+		assert(!interns.empty());
+		const size_t len{ static_cast<size_t>(end - start) };
+		const uint64_t hash{ hash_bytes(start, len) };
+		const size_t i{ intern_slots_find(intern_slots, interns, INVALID_INTERN_ID, start, len, hash) };
+		if (intern_slots[i].id != INVALID_INTERN_ID)
+		{
+			STAT_INC(STAT_INTERN_LOOKUPS);
+			*id = intern_slots[i].id;
+			return interns[*id].str;
+		}
+		// The slot index uses the low bits of the hash, so pick the shard with the high ones.
+		const InternId shard_index{ static_cast<InternId>(hash >> (64 - INTERN_SHARD_BITS)) };
+		InternShard &shard{ intern_shards[shard_index] };
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		*id = intern_insert(&shard.slots, &shard.strs, PROVISIONAL_INTERN_BIT | (shard_index << PROVISIONAL_INTERN_SHIFT),
+			(1u << PROVISIONAL_INTERN_SHIFT) - 1, &shard.arena, start, len, hash);
+		assert((*id & ((1u << PROVISIONAL_INTERN_SHIFT) - 1)) < shard.strs.size());
+		return shard.strs[*id & ((1u << PROVISIONAL_INTERN_SHIFT) - 1)].str;
+	}
+
+	static bool intern_str_less(const InternStr &a, const InternStr &b)
+	{
+		const int cmp{ std::memcmp(a.str, b.str, std::min(a.len, b.len)) };
+		return cmp < 0 || (cmp == 0 && a.len < b.len);
+	}
+
+	std::vector<InternStr> concurrent_interns_sorted()
+	{
+		std::vector<InternStr> sorted;
+		for (InternShard &shard : intern_shards)
+		{
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			sorted.insert(sorted.end(), shard.strs.begin(), shard.strs.end());
+		}
+		std::sort(sorted.begin(), sorted.end(), intern_str_less);
+		return sorted;
+	}
+
+	InternRemap merge_concurrent_interns()
+	{
+		InternRemap remap;
+		for (InternId shard_index{ 0 }; shard_index < NUM_INTERN_SHARDS; ++shard_index)
+		{
+			remap.shard_ids[shard_index].resize(intern_shards[shard_index].strs.size());
+		}
+		for (const InternStr &inStr : concurrent_interns_sorted())
+		{
+			const InternId provisional{ intern_id_of(inStr.str) };
+			const InternId id{ static_cast<InternId>(interns.size()) };
+			remap.shard_ids[(provisional & ~PROVISIONAL_INTERN_BIT) >> PROVISIONAL_INTERN_SHIFT][provisional & ((1u << PROVISIONAL_INTERN_SHIFT) - 1)] = id;
+
+			if (2 * (interns.size() + 1) > intern_slots.size())
+			{
+				intern_slots_grow(&intern_slots, std::max<size_t>(INTERNS_MIN_CAP, 2 * intern_slots.size()));
+			}
+			const size_t i{ intern_slots_find(intern_slots, interns, INVALID_INTERN_ID, inStr.str, inStr.len, inStr.hash) };
+			assert(intern_slots[i].id == INVALID_INTERN_ID);
+			intern_slots[i] = InternSlot{ id, static_cast<uint32_t>(inStr.hash) };
+			interns.push_back(inStr);
+			std::memcpy(const_cast<char *>(inStr.str) - sizeof(InternId), &id, sizeof(InternId));
+		}
+		for (InternShard &shard : intern_shards)
+		{
+			// The strings now belong to str_arena, the shard starts over with a fresh block.
+			arena_move_blocks(&str_arena, &shard.arena);
+			shard.strs.clear();
+			shard.slots.clear();
+		}
+		return remap;
+	}
+
+	char *read_file(const char *path, size_t *len)
+	{
+		FILE *file{ std::fopen(path, "rb") };
+		if (!file)
+		{
+			return nullptr;
+		}
+		std::fseek(file, 0, SEEK_END);
+		const long size{ std::ftell(file) };
+		std::fseek(file, 0, SEEK_SET);
+		if (size < 0)
+		{
+			std::fclose(file);
+			return nullptr;
+		}
+		auto *buf = static_cast<char *>(xmalloc(static_cast<size_t>(size) + 1));
+		if (size != 0 && std::fread(buf, static_cast<size_t>(size), 1, file) != 1)
+		{
+			std::fclose(file);
+			std::free(buf);
+			return nullptr;
+		}
+		std::fclose(file);
+		buf[size] = 0;
+		if (len)
+		{
+			*len = static_cast<size_t>(size);
+		}
+		return buf;
+	}
+	bool write_file(const char *path, const void *data, size_t len)
+	{
+		FILE *file{ std::fopen(path, "wb") };
+		if (!file)
+		{
+			return false;
+		}
+		const bool ok{ len == 0 || std::fwrite(data, len, 1, file) == 1 };
+		return std::fclose(file) == 0 && ok;
+	}
 }
\ No newline at end of file
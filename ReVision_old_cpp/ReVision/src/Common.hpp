@@ -6,11 +6,13 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 
 #include <algorithm>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #define ALIGN_DOWN(n, a) ((n) & ~((a) - 1))
@@ -26,34 +28,176 @@ namespace ReVision
 
 	void fatal(const char *fmt, ...);
 	void syntax_error(const char *fmt, ...);
+	// Errors reported on the calling thread so far. A file lexed on one thread
+	// had no errors if this didn't change while lexing it.
+	inline thread_local size_t thread_error_count{ 0 };
 	void fatal_syntax_error(const char *fmt, ...);
 
+	struct ArenaBlock
+	{
+		char *base;
+		size_t size;
+	};
+
+	// Bump allocator over a list of blocks. Blocks [0, num_used) hold live allocations,
+	// the rest were released by a reset and are handed out again before anything new
+	// is allocated. Block sizes double from ARENA_MIN_BLOCK_SIZE up to ARENA_MAX_BLOCK_SIZE.
+	// An arena set up with arena_init_reserved instead owns one reserved address range,
+	// kept as a single block whose size is the committed part, and only falls back to
+	// malloc'd blocks once the reservation is full.
 	struct Arena
 	{
+		char *ptr{ nullptr };
+		char *end{ nullptr };
+		std::vector<ArenaBlock> blocks;
+		size_t num_used{ 0 };
+		size_t bytes_used{ 0 };
+		char *reserve_base{ nullptr };
+		size_t reserve_size{ 0 };
+	};
+
+	struct ArenaMark
+	{
+		size_t num_used;
 		char *ptr;
-		char *end;
-		std::vector<char *> blocks;
+		size_t bytes_used;
+	};
+
+	struct ArenaStats
+	{
+		size_t bytes_used;
+		size_t bytes_reserved;
+		size_t num_blocks;
 	};
 
 	#define ARENA_ALIGNMENT 8
-	#define ARENA_BLOCK_SIZE 1024
+	#define ARENA_MIN_BLOCK_SIZE (4 * 1024)
+	#define ARENA_MAX_BLOCK_SIZE (1024 * 1024)
+	// Reserved arenas commit in steps of one 2 MiB huge page
+	#define ARENA_COMMIT_SIZE (2 * 1024 * 1024)
+	// Reserves reserve_size bytes of address space for an empty arena and asks for
+	// transparent huge pages where the OS has them. Returns false and leaves the
+	// arena on malloc'd blocks if the range can't be reserved.
+	bool arena_init_reserved(Arena *arena, size_t reserve_size);
 	void arena_grow(Arena *arena, size_t min_size);
 	void *arena_alloc(Arena *arena, size_t size);
+	// Everything allocated after the mark is released by arena_reset_to_mark, the blocks are kept.
+	ArenaMark arena_mark(const Arena *arena);
+	void arena_reset_to_mark(Arena *arena, ArenaMark mark);
+	// Releases every allocation but keeps the blocks for reuse.
+	void arena_reset(Arena *arena);
+	// Moves the live blocks of src into dst, src is left empty with only its spare blocks.
+	// Marks taken on either arena before the move are invalid afterwards.
+	// src can't be a reserved arena.
+	void arena_move_blocks(Arena *dst, Arena *src);
 	void arena_free(Arena *arena);
+	ArenaStats arena_stats(const Arena *arena);
+
+	uint64_t hash_bytes(const void *ptr, size_t len);
+	// XXH64, for hashing whole files where FNV-1a's byte at a time loop is too slow.
+	uint64_t xxhash64(const void *ptr, size_t len, uint64_t seed);
+
+	// Dense handle of an interned string, an index into interns.
+	typedef uint32_t InternId;
+	#define INVALID_INTERN_ID UINT32_MAX
 
 	struct InternStr
 	{
-		InternStr(size_t len, const char *str)
-			: len(len), str(str)
+		InternStr()
+			: len(0), hash(0), str(nullptr)
+		{}
+		InternStr(size_t len, uint64_t hash, const char *str)
+			: len(len), hash(hash), str(str)
 		{}
 
 		size_t len;
+		uint64_t hash;
 		const char *str;
 	};
 
+	// Open addressing slot. The low hash bits are kept next to the id so probes
+	// only touch interns on a likely match.
+	struct InternSlot
+	{
+		InternId id;
+		uint32_t hash;
+	};
+
+	// The slot table uses linear probing, its capacity is always a power of two.
+	// Empty slots have id == INVALID_INTERN_ID.
+	// Every interned string is preceded by its InternId in the arena, which makes
+	// intern_id_of O(1).
+	#define INTERNS_MIN_CAP 256
 	extern Arena str_arena;
 	extern std::vector<InternStr> interns;
+	extern std::vector<InternSlot> intern_slots;
 
+	// Seeds the table with the keywords, so they own the ids 0..NUM_KEYWORDS-1.
+	// Every intern function does this on first use.
+	void init_interns();
+
+	InternId intern_id_range(const char *start, const char *end);
+	InternId intern_id(const char *str);
 	const char *str_intern_range(const char *start, const char *end);
+	const char *str_intern_range(const char *start, const char *end, InternId *id);
 	const char *str_intern(const char *str);
-} // namespace Ion
\ No newline at end of file
+
+	inline const char *intern_str(InternId id) { return interns[id].str; }
+	inline size_t intern_len(InternId id) { return interns[id].len; }
+	inline uint64_t intern_hash(InternId id) { return interns[id].hash; }
+	// str must have been returned by one of the intern functions.
+	inline InternId intern_id_of(const char *str)
+	{
+		InternId id;
+		std::memcpy(&id, str - sizeof(InternId), sizeof(InternId));
+		return id;
+	}
+
+	// Lock-striped interner for lexers running on worker threads. Each shard has
+	// its own table and arena block chain, the shard is picked by the string's hash.
+	// Names already in interns (keywords and everything merged before) are found
+	// there first without taking a lock, so interns must not change while workers run.
+	// New names get provisional ids until merge_concurrent_interns assigns the final ones.
+	#define INTERN_SHARD_BITS 6
+	#define NUM_INTERN_SHARDS (1 << INTERN_SHARD_BITS)
+	#define PROVISIONAL_INTERN_BIT 0x80000000u
+	#define PROVISIONAL_INTERN_SHIFT (31 - INTERN_SHARD_BITS)
+	struct InternShard
+	{
+		std::mutex mutex;
+		Arena arena;
+		std::vector<InternStr> strs;
+		std::vector<InternSlot> slots;
+	};
+
+	extern InternShard intern_shards[NUM_INTERN_SHARDS];
+
+	inline bool is_provisional_intern_id(InternId id) { return (id & PROVISIONAL_INTERN_BIT) != 0; }
+	const char *str_intern_range_concurrent(const char *start, const char *end, InternId *id);
+	// All strings interned into the shards, ordered by their bytes. The order only
+	// depends on which names were interned, not on the number of threads or timing.
+	std::vector<InternStr> concurrent_interns_sorted();
+
+	// Maps provisional ids to the final ones.
+	struct InternRemap
+	{
+		std::vector<InternId> shard_ids[NUM_INTERN_SHARDS];
+
+		InternId resolve(InternId id) const
+		{
+			if (!is_provisional_intern_id(id))
+			{
+				return id;
+			}
+			return shard_ids[(id & ~PROVISIONAL_INTERN_BIT) >> PROVISIONAL_INTERN_SHIFT][id & ((1u << PROVISIONAL_INTERN_SHIFT) - 1)];
+		}
+	};
+
+	// Appends the shard strings to interns in concurrent_interns_sorted order, so
+	// the final ids are the same for any thread count. Pointers handed out by the
+	// shards stay valid and canonical.
+	InternRemap merge_concurrent_interns();
+
+	char *read_file(const char *path, size_t *len);
+	bool write_file(const char *path, const void *data, size_t len);
+} // namespace ReVision
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "Diag.hpp"
+#include "Lex.hpp"
+
+#include <iterator>
+
+namespace ReVision
+{
+	size_t diag_max_errors{ DIAG_DEFAULT_MAX_ERRORS };
+
+	// Buffers are never freed, so what a thread reported survives the thread itself.
+	static std::mutex thread_diags_mutex;
+	static std::vector<std::unique_ptr<DiagBuffer>> all_thread_diags;
+
+	static void flush_diags_at_exit()
+	{
+		flush_diags(stdout);
+	}
+
+	DiagBuffer *register_thread_diags()
+	{
+		std::lock_guard<std::mutex> lock(thread_diags_mutex);
+		if (all_thread_diags.empty())
+		{
+			// Registered after all_thread_diags was constructed, so it runs before it is destroyed
+			std::atexit(flush_diags_at_exit);
+		}
+		all_thread_diags.push_back(std::make_unique<DiagBuffer>());
+		return all_thread_diags.back().get();
+	}
+
+	static std::string format_message(const char *fmt, va_list args)
+	{
+		va_list args_copy;
+		va_copy(args_copy, args);
+		const int len{ std::vsnprintf(nullptr, 0, fmt, args_copy) };
+		va_end(args_copy);
+		if (len <= 0)
+		{
+			return std::string{};
+		}
+		std::string message(static_cast<size_t>(len), '\0');
+		std::vsnprintf(&message[0], message.size() + 1, fmt, args);
+		return message;
+	}
+
+	// Counts the diagnostic and returns whether it is still under the cap.
+	static bool count_diag(DiagBuffer &buffer, DiagSeverity severity)
+	{
+		size_t &count{ severity == DIAG_WARNING ? buffer.num_warnings : buffer.num_errors };
+		++count;
+		return severity == DIAG_FATAL || diag_max_errors == 0 || count <= diag_max_errors;
+	}
+
+	DiagMark diag_mark()
+	{
+		const DiagBuffer &buffer{ thread_diags() };
+		return DiagMark{ buffer.diags.size(), buffer.num_errors, buffer.num_warnings, thread_error_count };
+	}
+	void diag_rollback(const DiagMark &mark)
+	{
+		DiagBuffer &buffer{ thread_diags() };
+		assert(mark.num_diags <= buffer.diags.size());
+		buffer.diags.resize(mark.num_diags);
+		buffer.num_errors = mark.num_errors;
+		buffer.num_warnings = mark.num_warnings;
+		thread_error_count = mark.thread_errors;
+	}
+
+	void report_diag(DiagSeverity severity, const char *fmt, va_list args)
+	{
+		DiagBuffer &buffer{ thread_diags() };
+		if (count_diag(buffer, severity))
+		{
+			buffer.diags.push_back(Diagnostic{ severity, 0, 0, std::string{}, format_message(fmt, args) });
+		}
+	}
+	void report_diag_at(DiagSeverity severity, const LineTable *file, uint32_t offset, const char *fmt, va_list args)
+	{
+		DiagBuffer &buffer{ thread_diags() };
+		if (count_diag(buffer, severity))
+		{
+			const SrcLoc loc{ resolve_pos(SrcPos{ file, offset }) };
+			buffer.diags.push_back(Diagnostic{ severity, loc.line, loc.col, std::string{ loc.name }, format_message(fmt, args) });
+		}
+	}
+
+	static const char *severity_name(DiagSeverity severity)
+	{
+		switch (severity)
+		{
+			case DIAG_WARNING: return "warning";
+			case DIAG_ERROR: return "error";
+			case DIAG_FATAL: return "fatal error";
+		}
+		return "<unknown>";
+	}
+
+	std::string take_diags()
+	{
+		std::vector<Diagnostic> diags;
+		size_t num_errors{ 0 };
+		size_t num_warnings{ 0 };
+		{
+			std::lock_guard<std::mutex> lock(thread_diags_mutex);
+			for (const std::unique_ptr<DiagBuffer> &buffer : all_thread_diags)
+			{
+				std::move(buffer->diags.begin(), buffer->diags.end(), std::back_inserter(diags));
+				num_errors += buffer->num_errors;
+				num_warnings += buffer->num_warnings;
+				*buffer = DiagBuffer{};
+			}
+		}
+		// A file is lexed by one thread, so the stable sort keeps each file's
+		// diagnostics at the same position in the order they were reported.
+		// Lines and columns rather than offsets, a streamed file has no single text.
+		std::stable_sort(diags.begin(), diags.end(), [](const Diagnostic &a, const Diagnostic &b)
+		{
+			const int cmp{ a.file.compare(b.file) };
+			if (cmp != 0) { return cmp < 0; }
+			return a.line != b.line ? a.line < b.line : a.col < b.col;
+		});
+
+		std::string out;
+		size_t shown_errors{ 0 };
+		size_t shown_warnings{ 0 };
+		for (const Diagnostic &diag : diags)
+		{
+			size_t &shown{ diag.severity == DIAG_WARNING ? shown_warnings : shown_errors };
+			if (diag.severity != DIAG_FATAL && diag_max_errors != 0 && shown >= diag_max_errors)
+			{
+				continue;
+			}
+			++shown;
+			if (!diag.file.empty())
+			{
+				out += diag.file;
+				out += '(' + std::to_string(diag.line) + ',' + std::to_string(diag.col) + "): ";
+			}
+			out += severity_name(diag.severity);
+			out += ": ";
+			out += diag.message;
+			out += '\n';
+		}
+		if (num_errors > shown_errors)
+		{
+			out += std::to_string(num_errors - shown_errors) + " more errors not shown\n";
+		}
+		if (num_warnings > shown_warnings)
+		{
+			out += std::to_string(num_warnings - shown_warnings) + " more warnings not shown\n";
+		}
+		return out;
+	}
+
+	void flush_diags(FILE *file)
+	{
+		const std::string out{ take_diags() };
+		if (!out.empty())
+		{
+			std::fwrite(out.data(), 1, out.size(), file);
+			std::fflush(file);
+		}
+	}
+}
\ No newline at end of file
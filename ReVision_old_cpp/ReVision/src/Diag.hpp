@@ -0,0 +1,78 @@
+#pragma once
+#include "Common.hpp"
+
+namespace ReVision
+{
+	struct LineTable;
+
+	enum DiagSeverity : uint8_t
+	{
+		DIAG_WARNING,
+		DIAG_ERROR,
+		DIAG_FATAL,
+	};
+
+	// The position is resolved when a diagnostic is recorded, since the lexer
+	// owning the line table may be gone by the time the buffers are flushed.
+	struct Diagnostic
+	{
+		DiagSeverity severity;
+		// line and col are 0 for diagnostics without a position
+		int line;
+		int col;
+		std::string file;
+		std::string message;
+	};
+
+	struct DiagBuffer
+	{
+		std::vector<Diagnostic> diags;
+		// Everything reported, including what was past the cap and not kept
+		size_t num_errors;
+		size_t num_warnings;
+	};
+
+	// Errors and warnings a thread keeps, and a flush prints, 0 for no limit.
+	// Past the cap they are only counted, their message is never formatted.
+	// With several threads the count stays exact but which ones get printed
+	// depends on how files were spread over the threads.
+	#define DIAG_DEFAULT_MAX_ERRORS 100
+	extern size_t diag_max_errors;
+
+	// Every thread records into its own buffer, registered the first time it
+	// reports something, so reporting never takes a lock or writes to stdout.
+	DiagBuffer *register_thread_diags();
+	inline thread_local DiagBuffer *thread_diag_buffer{ nullptr };
+
+	inline DiagBuffer &thread_diags()
+	{
+		if (!thread_diag_buffer)
+		{
+			thread_diag_buffer = register_thread_diags();
+		}
+		return *thread_diag_buffer;
+	}
+
+	// What the calling thread has reported so far. Rolling back to a mark drops
+	// everything reported since, for lexers that retry a token with more input.
+	struct DiagMark
+	{
+		size_t num_diags;
+		size_t num_errors;
+		size_t num_warnings;
+		size_t thread_errors;
+	};
+	DiagMark diag_mark();
+	void diag_rollback(const DiagMark &mark);
+
+	void report_diag(DiagSeverity severity, const char *fmt, va_list args);
+	void report_diag_at(DiagSeverity severity, const LineTable *file, uint32_t offset, const char *fmt, va_list args);
+
+	// Collects the buffers of every thread, sorted by file and position, formatted
+	// and capped, and empties them. Only safe while no other thread reports,
+	// e.g. after parallel_for returns.
+	std::string take_diags();
+	// Writes take_diags() with a single write. Also runs at exit, so nothing
+	// reported is lost when a flush is skipped.
+	void flush_diags(FILE *file);
+}
\ No newline at end of file
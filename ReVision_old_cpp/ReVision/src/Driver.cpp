@@ -0,0 +1,282 @@
+#include "Driver.hpp"
+#include "Bench.hpp"
+#include "Diag.hpp"
+#include "Stats.hpp"
+#include "TokenCache.hpp"
+
+#include <chrono>
+
+namespace ReVision
+{
+	void lex_file(Lexer *lexer, SourceFile *file)
+	{
+		tokenize_all(lexer, file->path, file->text, &file->tokens);
+	}
+
+	bool load_files(std::vector<SourceFile> &files)
+	{
+		PhaseTimer timer{ PHASE_LOAD };
+		bool ok{ true };
+		for (SourceFile &file : files)
+		{
+			if (source_map(&file.map, file.path))
+			{
+				file.text = file.map.text;
+				file.len = file.map.len;
+			}
+			else
+			{
+				std::printf("error: could not read '%s'\n", file.path);
+				file.text = nullptr;
+				file.len = 0;
+				ok = false;
+			}
+		}
+		return ok;
+	}
+	void free_files(std::vector<SourceFile> &files)
+	{
+		for (SourceFile &file : files)
+		{
+			source_unmap(&file.map);
+			file.text = nullptr;
+		}
+	}
+
+	LexStats lex_files(std::vector<SourceFile> &files, size_t num_threads, const char *cache_dir)
+	{
+		init_keywords();
+		ThreadPool pool(num_threads);
+
+		// Biggest files first, so the stragglers at the end are the cheap ones.
+		std::vector<size_t> order(files.size());
+		for (size_t i{ 0 }; i < files.size(); ++i)
+		{
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return files[a].len > files[b].len; });
+
+		LexStats stats{};
+		if (cache_dir && !make_token_cache_dir(cache_dir))
+		{
+			std::printf("warning: could not create token cache directory '%s'\n", cache_dir);
+			cache_dir = nullptr;
+		}
+		std::vector<uint64_t> content_hashes(files.size());
+		std::vector<uint8_t> cached(files.size());
+		std::vector<uint8_t> cacheable(files.size());
+		const auto start{ std::chrono::steady_clock::now() };
+		PhaseTimer timer{ PHASE_LEX };
+		pool.parallel_for(order.size(), [&](size_t, size_t task)
+		{
+			const size_t index{ order[task] };
+			SourceFile &file{ files[index] };
+			if (!file.text)
+			{
+				return;
+			}
+			if (cache_dir)
+			{
+				content_hashes[index] = xxhash64(file.text, file.len, 0);
+				const std::string path{ token_cache_path(cache_dir, content_hashes[index]) };
+				if (load_token_cache(path.c_str(), file.path, file.text, file.len, content_hashes[index], str_intern_range_concurrent, &file.tokens))
+				{
+					STAT_INC(STAT_TOKEN_CACHE_HITS);
+					cached[index] = 1;
+					return;
+				}
+				STAT_INC(STAT_TOKEN_CACHE_MISSES);
+			}
+			// Errors are only reported while lexing, so a file that had any must be lexed again next time
+			const size_t num_errors{ thread_error_count };
+			Lexer lexer;
+			lexer.intern_range = str_intern_range_concurrent;
+			lex_file(&lexer, &file);
+			cacheable[index] = cache_dir && thread_error_count == num_errors;
+		});
+		timer.next(PHASE_MERGE_INTERNS);
+		const InternRemap remap{ merge_concurrent_interns() };
+		timer.next(PHASE_REMAP);
+		pool.parallel_for(files.size(), [&](size_t, size_t task)
+		{
+			files[task].tokens.remap_names(remap);
+		});
+		if (cache_dir)
+		{
+			// Needs the final ids, names are stored as strings
+			timer.next(PHASE_CACHE_WRITE);
+			pool.parallel_for(files.size(), [&](size_t, size_t task)
+			{
+				if (cacheable[task])
+				{
+					const std::string path{ token_cache_path(cache_dir, content_hashes[task]) };
+					save_token_cache(path.c_str(), files[task].tokens, content_hashes[task]);
+				}
+			});
+		}
+		timer.stop();
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		for (const SourceFile &file : files)
+		{
+			stats.num_files += file.text ? 1 : 0;
+			stats.num_bytes += file.len;
+			stats.num_tokens += file.tokens.size();
+		}
+		for (uint8_t hit : cached)
+		{
+			stats.num_cached += hit;
+		}
+		return stats;
+	}
+
+	LexStats stream_lex_files(std::vector<SourceFile> &files, size_t chunk_size, size_t *max_buffer_size, bool *ok)
+	{
+		init_keywords();
+		LexStats stats{};
+		*max_buffer_size = 0;
+		*ok = true;
+		const auto start{ std::chrono::steady_clock::now() };
+		PhaseTimer timer{ PHASE_LEX };
+		for (SourceFile &file : files)
+		{
+			StreamLexStats file_stats;
+			if (!stream_lex_file(file.path, chunk_size, &file_stats))
+			{
+				std::printf("error: could not read '%s'\n", file.path);
+				*ok = false;
+				continue;
+			}
+			++stats.num_files;
+			stats.num_bytes += static_cast<size_t>(file_stats.num_bytes);
+			stats.num_tokens += static_cast<size_t>(file_stats.num_tokens);
+			*max_buffer_size = std::max(*max_buffer_size, file_stats.max_buffer_size);
+		}
+		timer.stop();
+		stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return stats;
+	}
+
+	void print_lex_stats(const LexStats &stats, size_t num_threads)
+	{
+		const double seconds{ std::max(stats.seconds, 1e-9) };
+		std::printf("lexed %zu files, %zu bytes, %zu tokens on %zu threads in %.3f ms\n",
+			stats.num_files, stats.num_bytes, stats.num_tokens, num_threads, stats.seconds * 1000.0);
+		std::printf("%.2f MB/s, %.0f tokens/s\n",
+			static_cast<double>(stats.num_bytes) / (1024.0 * 1024.0) / seconds,
+			static_cast<double>(stats.num_tokens) / seconds);
+		if (stats.num_cached)
+		{
+			std::printf("%zu of %zu files loaded from the token cache\n", stats.num_cached, stats.num_files);
+		}
+		const ArenaStats arena{ arena_stats(&str_arena) };
+		std::printf("interned strings: %zu bytes used, %zu bytes reserved in %zu blocks\n",
+			arena.bytes_used, arena.bytes_reserved, arena.num_blocks);
+	}
+
+	#define RESERVED_STR_ARENA_SIZE (4ull * 1024 * 1024 * 1024)
+
+	int driver_main(int argc, char **argv)
+	{
+		size_t num_threads{ default_thread_count() };
+		bool show_stats{ false };
+		const char *cache_dir{ nullptr };
+		size_t stream_chunk_size{ 0 };
+		std::vector<SourceFile> files;
+		for (int i{ 1 }; i < argc; ++i)
+		{
+			if (std::strcmp(argv[i], "--bench") == 0)
+			{
+				return bench_main(argc - i - 1, argv + i + 1);
+			}
+			else if (std::strcmp(argv[i], "--reserved-arena") == 0)
+			{
+				// One reserved range for every interned string instead of malloc'd blocks
+				if (!arena_init_reserved(&str_arena, RESERVED_STR_ARENA_SIZE))
+				{
+					std::printf("warning: could not reserve address space, using malloc'd arena blocks\n");
+				}
+			}
+			else if (std::strncmp(argv[i], "--cache-dir=", 12) == 0)
+			{
+				cache_dir = argv[i] + 12;
+			}
+			else if (std::strncmp(argv[i], "--max-errors=", 13) == 0)
+			{
+				// 0 prints every error
+				char *end;
+				const long n{ std::strtol(argv[i] + 13, &end, 10) };
+				if (n < 0 || *end || end == argv[i] + 13)
+				{
+					std::printf("error: invalid error limit '%s'\n", argv[i]);
+					return 1;
+				}
+				diag_max_errors = static_cast<size_t>(n);
+			}
+			else if (std::strcmp(argv[i], "--stream") == 0)
+			{
+				stream_chunk_size = STREAM_DEFAULT_CHUNK_SIZE;
+			}
+			else if (std::strncmp(argv[i], "--stream=", 9) == 0)
+			{
+				char *end;
+				const long kb{ std::strtol(argv[i] + 9, &end, 10) };
+				if (kb <= 0 || *end)
+				{
+					std::printf("error: invalid chunk size '%s'\n", argv[i]);
+					return 1;
+				}
+				stream_chunk_size = static_cast<size_t>(kb) * 1024;
+			}
+			else if (std::strcmp(argv[i], "--stats") == 0)
+			{
+				show_stats = true;
+			}
+			else if (std::strncmp(argv[i], "-j", 2) == 0)
+			{
+				const long n{ std::strtol(argv[i] + 2, nullptr, 10) };
+				if (n <= 0)
+				{
+					std::printf("error: invalid thread count '%s'\n", argv[i]);
+					return 1;
+				}
+				num_threads = static_cast<size_t>(n);
+			}
+			else
+			{
+				files.push_back(SourceFile{ argv[i], nullptr, 0, {}, {} });
+			}
+		}
+		if (files.empty())
+		{
+			std::printf("Usage: %s [-jN] [--reserved-arena] [--stats] [--cache-dir=dir] [--max-errors=N] [--stream[=KB]] file...\n       %s --bench [--json | --out=file.json] [--size=MB] [--seed=N] [--mix=name]...\n", argv[0], argv[0]);
+			return 1;
+		}
+
+		if (stream_chunk_size)
+		{
+			size_t max_buffer_size;
+			bool ok;
+			const LexStats stats{ stream_lex_files(files, stream_chunk_size, &max_buffer_size, &ok) };
+			flush_diags(stdout);
+			print_lex_stats(stats, 1);
+			std::printf("streamed in %zu byte chunks, largest buffer %zu bytes\n", stream_chunk_size, max_buffer_size);
+			if (show_stats)
+			{
+				print_stats(stdout);
+			}
+			return ok ? 0 : 1;
+		}
+
+		const bool ok{ load_files(files) };
+		const LexStats stats{ lex_files(files, num_threads, cache_dir) };
+		flush_diags(stdout);
+		print_lex_stats(stats, num_threads);
+		if (show_stats)
+		{
+			print_stats(stdout);
+		}
+		free_files(files);
+		return ok ? 0 : 1;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "Lex.hpp"
+#include "Source.hpp"
+#include "StreamLex.hpp"
+#include "ThreadPool.hpp"
+
+namespace ReVision
+{
+	struct SourceFile
+	{
+		const char *path;
+		const char *text;
+		size_t len;
+		TokenBuffer tokens;
+		SourceMap map;
+	};
+
+	struct LexStats
+	{
+		size_t num_files;
+		size_t num_bytes;
+		size_t num_tokens;
+		// Files whose tokens came from the token cache
+		size_t num_cached;
+		double seconds;
+	};
+
+	// Maps every file into memory. Files that can't be read are reported and keep text == nullptr.
+	bool load_files(std::vector<SourceFile> &files);
+	void free_files(std::vector<SourceFile> &files);
+	// Lexes every loaded file into its own token buffer on a work-stealing pool.
+	// New names are merged into interns in a deterministic order before returning.
+	// With a cache_dir, files seen before load their tokens from it instead, and
+	// files that lexed without errors are written back.
+	LexStats lex_files(std::vector<SourceFile> &files, size_t num_threads, const char *cache_dir = nullptr);
+	void lex_file(Lexer *lexer, SourceFile *file);
+	// Lexes the files one after the other through a StreamLexer without mapping
+	// them or keeping their tokens, so memory stays flat whatever their size.
+	// Files that can't be read are reported and set *ok to false.
+	LexStats stream_lex_files(std::vector<SourceFile> &files, size_t chunk_size, size_t *max_buffer_size, bool *ok);
+	void print_lex_stats(const LexStats &stats, size_t num_threads);
+
+	// Usage: ReVision [-jN] [--reserved-arena] [--stats] [--cache-dir=dir] [--max-errors=N] [--stream[=KB]] file...
+	//        ReVision --bench [options], see bench_main
+	int driver_main(int argc, char **argv);
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "Common.hpp"
+
+namespace ReVision
+{
+	// Returns the double nearest to w * 10^q, rounding ties to even.
+	// Tries Clinger's exact fast path first, then the Eisel-Lemire algorithm.
+	double decimal_to_double(uint64_t w, int64_t q);
+
+	struct FloatLiteral
+	{
+		double val;
+		const char *end;
+		// Set to the offending character if the exponent has no digits
+		const char *bad_exponent;
+	};
+
+	// Parses [0-9]*(.[0-9]*)?([eE][+-]?[0-9]+)? starting at start. int_end is the
+	// end of the leading digit run, which the lexer already knows. The digits are
+	// folded into the mantissa while scanning, literals with more than 19
+	// significant digits that can't be decided from the first 19 fall back to strtod.
+	FloatLiteral parse_float_literal(const char *start, const char *int_end);
+}
\ No newline at end of file
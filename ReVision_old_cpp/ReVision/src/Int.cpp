@@ -0,0 +1,106 @@
+#include "Int.hpp"
+
+namespace ReVision
+{
+	#define SWAR_ONES 0x0101010101010101ull
+	#define SWAR_HIGH_BITS 0x8080808080808080ull
+
+	// The SWAR helpers treat the first character as the lowest byte, which
+	// holds on every little endian target we build for.
+	static uint64_t load_eight(const char *p)
+	{
+		uint64_t x;
+		std::memcpy(&x, p, sizeof(x));
+		return x;
+	}
+
+	// Nonzero if any of the eight byte sized digit values is >= base (base <= 10)
+	static uint64_t swar_digits_at_least(uint64_t digits, uint64_t base)
+	{
+		return (digits + (0x80 - base) * SWAR_ONES) & SWAR_HIGH_BITS;
+	}
+
+	// Eight decimal digit values to their number, see "Fast numeric parsing" (Lemire, simdjson)
+	static uint64_t swar_decimal(uint64_t digits)
+	{
+		digits = (digits * 10) + (digits >> 8);
+		return (((digits & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+			(((digits >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+	}
+
+	// Eight digit values of bits_per_digit bits each to their number, pairing neighbours
+	// into bytes, then 16-bit and 32-bit lanes. No lane ever carries into the next.
+	static uint64_t swar_power_of_two(uint64_t digits, uint32_t bits_per_digit)
+	{
+		digits = ((digits << bits_per_digit) + (digits >> 8)) & 0x00FF00FF00FF00FFull;
+		digits = ((digits << (2 * bits_per_digit)) + (digits >> 16)) & 0x0000FFFF0000FFFFull;
+		return ((digits << (4 * bits_per_digit)) + (digits >> 32)) & 0xFFFFFFFFull;
+	}
+
+	// Hex characters to digit values: '0'-'9' keep their low nibble, letters get 9 added
+	static uint64_t swar_hex_values(uint64_t chars)
+	{
+		const uint64_t letters{ (chars & (0x40 * SWAR_ONES)) >> 6 };
+		return (chars & (0x0F * SWAR_ONES)) + letters * 9;
+	}
+
+	static uint64_t digit_value(char c)
+	{
+		return (c <= '9') ? static_cast<uint64_t>(c - '0') : static_cast<uint64_t>((c | 0x20) - 'a' + 10);
+	}
+
+	bool parse_int_digits(const char *start, const char *end, uint64_t base, uint64_t *val)
+	{
+		uint32_t bits_per_digit{ 0 };
+		// Digits that always fit into 64 bits, one more needs the checked multiply-add
+		size_t max_safe_digits{ 19 };
+		switch (base)
+		{
+		case 2: bits_per_digit = 1; max_safe_digits = 64; break;
+		case 8: bits_per_digit = 3; max_safe_digits = 21; break;
+		case 16: bits_per_digit = 4; max_safe_digits = 16; break;
+		default: break;
+		}
+
+		const char *p{ start };
+		while (p < end && *p == '0') { ++p; }
+		const size_t num_digits{ static_cast<size_t>(end - p) };
+		if (num_digits > max_safe_digits + 1)
+		{
+			return false;
+		}
+		const char *safe_end{ p + std::min(num_digits, max_safe_digits) };
+
+		uint64_t result{ 0 };
+		for (; p + 8 <= safe_end; p += 8)
+		{
+			const uint64_t chars{ load_eight(p) };
+			if (base == 16)
+			{
+				result = (result << 32) | swar_power_of_two(swar_hex_values(chars), 4);
+				continue;
+			}
+			const uint64_t digits{ chars - '0' * SWAR_ONES };
+			if (swar_digits_at_least(digits, base))
+			{
+				return false;
+			}
+			result = base == 10 ? result * 100000000 + swar_decimal(digits) : (result << (8 * bits_per_digit)) | swar_power_of_two(digits, bits_per_digit);
+		}
+		for (; p < end; ++p)
+		{
+			const uint64_t digit{ digit_value(*p) };
+			if (digit >= base)
+			{
+				return false;
+			}
+			if (p >= safe_end && result > (std::numeric_limits<uint64_t>::max() - digit) / base)
+			{
+				return false;
+			}
+			result = result * base + digit;
+		}
+		*val = result;
+		return true;
+	}
+}
\ No newline at end of file
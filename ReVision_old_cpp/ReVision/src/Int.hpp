@@ -0,0 +1,10 @@
+#pragma once
+#include "Common.hpp"
+
+namespace ReVision
+{
+	// Converts the digit run [start, end) in base 2, 8, 10 or 16, eight digits per step.
+	// Returns false if a digit is out of range for the base or the value doesn't fit
+	// in 64 bits, the caller rescans those to report the exact diagnostic.
+	bool parse_int_digits(const char *start, const char *end, uint64_t base, uint64_t *val);
+}
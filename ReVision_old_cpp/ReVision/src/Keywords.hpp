@@ -0,0 +1,176 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace ReVision
+{
+	// Every keyword in id order. The interner seeds its table with these before
+	// anything else, so keyword ids are always 0..NUM_KEYWORDS-1.
+	#define KEYWORD_LIST(X) \
+		X(typedef) \
+		X(enum) \
+		X(struct) \
+		X(union) \
+		X(const) \
+		X(func) \
+		X(sizeof) \
+		X(alignof) \
+		X(typeof) \
+		X(offsetof) \
+		X(break) \
+		X(continue) \
+		X(return) \
+		X(if) \
+		X(else) \
+		X(while) \
+		X(do) \
+		X(for) \
+		X(switch) \
+		X(case) \
+		X(default) \
+		X(import) \
+		X(jmp) /* goto */ \
+		/* X(asm) inline assembly */ \
+		/* X(jmpif) conditional goto */ \
+		/* X(use) reduces scope to capture list */ \
+		/* X(class) No inheritance */ \
+		/* X(namespace) */ \
+		/* X(new) */ \
+		/* X(delete) */
+
+	enum KeywordId
+	{
+		#define KEYWORD_ID(name) name##_keyword_id,
+		KEYWORD_LIST(KEYWORD_ID)
+		#undef KEYWORD_ID
+		NUM_KEYWORDS
+	};
+
+	inline constexpr const char *keyword_names[NUM_KEYWORDS]{
+		#define KEYWORD_NAME(name) #name,
+		KEYWORD_LIST(KEYWORD_NAME)
+		#undef KEYWORD_NAME
+	};
+	inline constexpr uint8_t keyword_lens[NUM_KEYWORDS]{
+		#define KEYWORD_LEN(name) sizeof(#name) - 1,
+		KEYWORD_LIST(KEYWORD_LEN)
+		#undef KEYWORD_LEN
+	};
+
+	// Perfect hash over KEYWORD_LIST, built by the compiler. The key packs the
+	// length with the first, middle and last characters and a multiplier is
+	// searched for that sends every keyword to its own slot, so the lexer can
+	// classify an identifier from its bytes alone. Each slot keeps the full key,
+	// which turns almost every plain name away with one compare before any
+	// bytes are looked at.
+	#define KEYWORD_HASH_BITS 7
+	#define KEYWORD_HASH_SIZE (1 << KEYWORD_HASH_BITS)
+	#define KEYWORD_HASH_MAX_TRIES (1 << 12)
+	static_assert(NUM_KEYWORDS < KEYWORD_HASH_SIZE);
+
+	struct KeywordHashTable
+	{
+		uint32_t multiplier; // 0 if the search failed
+		uint32_t keys[KEYWORD_HASH_SIZE]; // 0 for an empty slot, no key is 0
+		uint8_t ids[KEYWORD_HASH_SIZE];
+	};
+
+	// len must be at least 1. Lengths saturate at 255, which no keyword reaches.
+	constexpr uint32_t keyword_hash_key(const char *str, size_t len)
+	{
+		const uint32_t key_len{ static_cast<uint32_t>(len < 255 ? len : 255) };
+		return static_cast<uint32_t>(static_cast<uint8_t>(str[0])) | static_cast<uint32_t>(static_cast<uint8_t>(str[len / 2])) << 8
+			| static_cast<uint32_t>(static_cast<uint8_t>(str[len - 1])) << 16 | key_len << 24;
+	}
+	constexpr uint32_t keyword_hash_slot(uint32_t key, uint32_t multiplier)
+	{
+		return (key * multiplier) >> (32 - KEYWORD_HASH_BITS);
+	}
+
+	constexpr size_t keyword_name_len(const char *name)
+	{
+		size_t len{ 0 };
+		while (name[len])
+		{
+			++len;
+		}
+		return len;
+	}
+
+	// Searches for a multiplier over any list of names, ids are their indices.
+	constexpr KeywordHashTable make_keyword_hash_table(const char *const *names, size_t num_names)
+	{
+		// No multiplier separates two equal keys, fail before searching for one
+		for (size_t i{ 0 }; i < num_names; ++i)
+		{
+			for (size_t j{ 0 }; j < i; ++j)
+			{
+				if (keyword_hash_key(names[i], keyword_name_len(names[i])) == keyword_hash_key(names[j], keyword_name_len(names[j])))
+				{
+					return KeywordHashTable{};
+				}
+			}
+		}
+		for (uint32_t try_index{ 0 }; try_index < KEYWORD_HASH_MAX_TRIES && num_names < KEYWORD_HASH_SIZE; ++try_index)
+		{
+			KeywordHashTable table{};
+			table.multiplier = (try_index * 0x9E3779B9u) | 1;
+			bool ok{ true };
+			for (uint32_t id{ 0 }; id < num_names && ok; ++id)
+			{
+				const uint32_t key{ keyword_hash_key(names[id], keyword_name_len(names[id])) };
+				const uint32_t slot{ keyword_hash_slot(key, table.multiplier) };
+				ok = (table.keys[slot] == 0);
+				table.keys[slot] = key;
+				table.ids[slot] = static_cast<uint8_t>(id);
+			}
+			if (ok)
+			{
+				return table;
+			}
+		}
+		return KeywordHashTable{};
+	}
+
+	inline constexpr KeywordHashTable keyword_hash_table{ make_keyword_hash_table(keyword_names, NUM_KEYWORDS) };
+
+	constexpr bool keyword_lens_valid()
+	{
+		for (uint8_t len : keyword_lens)
+		{
+			if (len == 0 || len == 255)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	// Adding a keyword can only fail here, at compile time: no multiplier
+	// separates the set when two keywords share length and first, middle and last
+	// characters, or when KEYWORD_HASH_BITS needs to grow.
+	static_assert(keyword_lens_valid(), "keyword length must be 1..254");
+	static_assert(keyword_hash_table.multiplier != 0, "no perfect hash for KEYWORD_LIST");
+
+	// Returns the KeywordId spelled by [str, str+len), or NUM_KEYWORDS if it is
+	// not a keyword. len must be at least 1.
+	inline uint32_t keyword_id_of(const char *str, size_t len)
+	{
+		const uint32_t key{ keyword_hash_key(str, len) };
+		const uint32_t slot{ keyword_hash_slot(key, keyword_hash_table.multiplier) };
+		if (keyword_hash_table.keys[slot] != key)
+		{
+			return NUM_KEYWORDS;
+		}
+		// The key matched the length and three characters, check the rest
+		const uint32_t id{ keyword_hash_table.ids[slot] };
+		const char *name{ keyword_names[id] };
+		for (size_t i{ 1 }; i < len - 1; ++i)
+		{
+			if (name[i] != str[i])
+			{
+				return NUM_KEYWORDS;
+			}
+		}
+		return id;
+	}
+}
\ No newline at end of file
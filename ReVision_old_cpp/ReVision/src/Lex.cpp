@@ -1,4 +1,8 @@
 #include "Lex.hpp"
+#include "Diag.hpp"
+#include "Float.hpp"
+#include "Int.hpp"
+#include "Stats.hpp"
 
 namespace ReVision
 {
@@ -55,11 +59,9 @@ namespace ReVision
 	const char *const_keyword;
 	const char *string_keyword; // string with char as character type
 	*/
-	const char *first_keyword;
-	const char *last_keyword;
 	std::vector<const char *> keywords;
 
-	#define KEYWORD(name) name##_keyword = str_intern(#name); keywords.push_back(name##_keyword)
+	#define KEYWORD(name) name##_keyword = intern_str(name##_keyword_id); keywords.push_back(name##_keyword);
 	void init_keywords()
 	{
 		static bool inited;
@@ -67,55 +69,51 @@ namespace ReVision
 		{
 			return;
 		}
-		char *arena_end = str_arena.end;
-		KEYWORD(typedef);
-		KEYWORD(enum);
-		KEYWORD(struct);
-		KEYWORD(union);
-		KEYWORD(const);
-		KEYWORD(func);
-		KEYWORD(sizeof);
-		KEYWORD(alignof);
-		KEYWORD(typeof);
-		KEYWORD(offsetof);
-		KEYWORD(break);
-		KEYWORD(continue);
-		KEYWORD(return);
-		KEYWORD(if);
-		KEYWORD(else);
-		KEYWORD(while);
-		KEYWORD(do);
-		KEYWORD(for);
-		KEYWORD(switch);
-		KEYWORD(case);
-		KEYWORD(default);
-		KEYWORD(import);
-		KEYWORD(jmp); // goto
-
-		// KEYWORD(asm); // inline assembly
-		// KEYWORD(jmpif); // conditional goto
-		// KEYWORD(use); // reduces scope to capture list
-		// KEYWORD(class); // No inheritance
-		// KEYWORD(namespace);
-		// KEYWORD(new);
-		// KEYWORD(delete);
-
-		assert(str_arena.end == arena_end);
-		first_keyword = typedef_keyword;
-		last_keyword = jmp_keyword;
+		init_interns();
+		KEYWORD_LIST(KEYWORD)
 		inited = true;
 	}
 	#undef KEYWORD
 	
 	bool is_keyword_name(const char *name)
 	{
-		return first_keyword <= name && name <= last_keyword;
+		return is_keyword_id(intern_id_of(name));
 	}
 
-	SrcPos pos_builtin{ "<builtin>", 0 };
-	Token token;
-	const char *stream;
-	const char *line_start;
+	SrcPos pos_builtin{ nullptr, 0 };
+	Lexer default_lexer;
+	Token &token{ default_lexer.token };
+	const char *&stream{ default_lexer.stream };
+
+	void LineTable::init(const char *name, const char *text)
+	{
+		this->name = name;
+		this->text = text;
+		first_line = 1;
+		first_col = 1;
+		line_starts.clear();
+	}
+	SrcLoc LineTable::resolve(uint32_t offset) const
+	{
+		if (line_starts.empty())
+		{
+			line_starts.push_back(0);
+			scan_kernels.find_newlines(text, &line_starts);
+		}
+		// The last line starting at or before offset
+		const auto next_line{ std::upper_bound(line_starts.begin(), line_starts.end(), offset) };
+		const size_t line{ static_cast<size_t>(next_line - line_starts.begin()) };
+		const int col{ static_cast<int>(offset - line_starts[line - 1]) + 1 };
+		return SrcLoc{ name, first_line + static_cast<int>(line) - 1, line == 1 ? first_col + col - 1 : col };
+	}
+	SrcLoc resolve_pos(SrcPos pos)
+	{
+		if (!pos.file)
+		{
+			return SrcLoc{ "<builtin>", 0, 0 };
+		}
+		return pos.file->resolve(pos.offset);
+	}
 
 	const char *token_kind_name(Token::Kind kind)
 	{
@@ -174,11 +172,11 @@ namespace ReVision
 			case Token::RSHIFT_ASSIGN: return ">>=";
 			case Token::INC: return "++";
 			case Token::DEC: return "--";
-			case Token::COLON_ASSIGN: return "--";
+			case Token::COLON_ASSIGN: return ":=";
 		}
 		return "<unknown>";
 	};
-	const char *token_info()
+	const char *Lexer::token_info() const
 	{
 		if (token.kind == Token::NAME || token.kind == Token::KEYWORD) { return token.name; }
 		else { return token_kind_name(token.kind); }
@@ -186,28 +184,17 @@ namespace ReVision
 
 	void warning(SrcPos pos, const char *fmt, ...)
 	{
-		if (pos.name == NULL)
-		{
-			pos = pos_builtin;
-		}
 		va_list args;
 		va_start(args, fmt);
-		printf("%s(%d): warning: ", pos.name, pos.line);
-		vprintf(fmt, args);
-		printf("\n");
+		report_diag_at(DIAG_WARNING, pos.file, pos.offset, fmt, args);
 		va_end(args);
 	}
 	void error(SrcPos pos, const char *fmt, ...)
 	{
-		if (pos.name == NULL)
-		{
-			pos = pos_builtin;
-		}
+		++thread_error_count;
 		va_list args;
 		va_start(args, fmt);
-		printf("%s(%d): error: ", pos.name, pos.line);
-		vprintf(fmt, args);
-		printf("\n");
+		report_diag_at(DIAG_ERROR, pos.file, pos.offset, fmt, args);
 		va_end(args);
 	}
 
@@ -218,44 +205,51 @@ namespace ReVision
 
 	uint8_t char_to_digit(char c)
 	{
-		switch (c)
-		{
-		case '0': return 0;		case '1': return 1;		case '2': return 2;
-		case '3': return 3;		case '4': return 4;		case '5': return 5;
-		case '6': return 6;		case '7': return 7;		case '8': return 8;
-		case '9': return 9;
-		case 'a': case 'A': return 10;		case 'b': case 'B': return 11;
-		case 'c': case 'C': return 12;		case 'd': case 'D': return 13;
-		case 'e': case 'E': return 14;		case 'f': case 'F': return 15;
-		}
-		return 0;
+		return char_class_table.digits[static_cast<uint8_t>(c)];
+	}
+	void Lexer::scan_int()
+	{
+		scan_int(scan_kernels.skip_digits(stream));
 	}
-	void scan_int()
+	void Lexer::scan_int(const char *digits_end)
 	{
 		uint64_t base{ 10 };
 		if (*stream == '0')
 		{
 			++stream;
-			if (std::tolower(*stream) == 'x')
+			if (to_lower_char(*stream) == 'x')
 			{
 				++stream;
 				token.mod = Token::Mod::HEX;
 				base = 16;
 			}
-			else if (std::tolower(*stream) == 'b')
+			else if (to_lower_char(*stream) == 'b')
 			{
 				++stream;
 				token.mod = Token::Mod::BIN;
 				base = 2;
 			}
-			else if (std::isdigit(*stream) != 0)
+			else if (is_digit_char(*stream))
 			{
 				token.mod = Token::Mod::OCT;
 				base = 8;
 			}
 		}
 
+		// Find the digit run for the base. Any hex digit left behind it belongs to the literal
+		// and gets a diagnostic, as does overflow, so both take the character by character loop.
+		const char *end{ digits_end };
+		if (base == 2) { end = scan_kernels.skip_digits(stream); }
+		else if (base == 16) { for (end = stream; char_is(*end, CHAR_HEX); ++end) {} }
 		uint64_t val{ 0 };
+		if (!char_is(*end, CHAR_HEX) && parse_int_digits(stream, end, base, &val))
+		{
+			stream = end;
+			token.kind = Token::INT;
+			token.int_val = val;
+			return;
+		}
+
 		while (true)
 		{
 			uint64_t digit{ char_to_digit(*stream) };
@@ -269,7 +263,7 @@ namespace ReVision
 			if (val > (std::numeric_limits<uint64_t>::max() - digit) / base)
 			{
 				error_here("Integer literal overflow");
-				while (std::isdigit(*stream)) { ++stream; }
+				stream = scan_kernels.skip_digits(stream);
 				val = 0; break;
 			}
 			val = val * base + digit;
@@ -278,30 +272,30 @@ namespace ReVision
 		token.kind = Token::INT;
 		token.int_val = val;
 	}
-	void scan_float()
+	void Lexer::scan_float()
 	{
-		const char *start{ stream };
-		while (std::isdigit(*stream)) { ++stream; }
-		if (*stream == '.') { ++stream; }
-		while (std::isdigit(*stream)) { ++stream; }
-
-		if (tolower(*stream) == 'e')
+		scan_float(scan_kernels.skip_digits(stream));
+	}
+	void Lexer::scan_float(const char *digits_end)
+	{
+		const FloatLiteral lit{ parse_float_literal(stream, digits_end) };
+		if (lit.bad_exponent)
 		{
-			++stream;
-			if (*stream == '+' || *stream == '-') { ++stream; }
-			if (!std::isdigit(*stream))
-			{
-				error_here("Expected digit after float literal exponent, found '%c'.", *stream);
-			}
-			while (std::isdigit(*stream)) { ++stream; }
+			error_here("Expected digit after float literal exponent, found '%c'.", *lit.bad_exponent);
 		}
-		const double val{ std::strtod(start, nullptr) };
-		if (val == HUGE_VAL)
+		stream = lit.end;
+		if (std::isinf(lit.val))
 		{
 			error_here("Float literal overflow");
 		}
 		token.kind = Token::FLOAT;
-		token.float_val = val;
+		token.float_val = lit.val;
+	}
+	void Lexer::scan_number()
+	{
+		const char *digits_end{ scan_kernels.skip_digits(stream) };
+		if (*digits_end == '.' || to_lower_char(*digits_end) == 'e') { scan_float(digits_end); }
+		else { scan_int(digits_end); }
 	}
 	char escape_to_char(char c)
 	{
@@ -317,7 +311,7 @@ namespace ReVision
 		}
 		return 0;
 	}
-	void scan_char()
+	void Lexer::scan_char()
 	{
 		assert(*stream == '\''); ++stream;
 
@@ -352,11 +346,26 @@ namespace ReVision
 		token.int_val = val;
 		token.mod = Token::Mod::CHAR;
 	}
-	void scan_str()
+	void Lexer::scan_str()
 	{
 		assert(*stream == '"'); ++stream;
-		std::string str;
-		while ((*stream != 0) && *stream != '"')
+		const char *start{ stream };
+		while (*stream && *stream != '"' && *stream != '\\' && *stream != '\n')
+		{
+			++stream;
+		}
+		token.kind = Token::STR;
+		if (*stream == '"')
+		{
+			// No escapes, so the source bytes are the literal
+			token.str_val = intern_range(start, stream, &token.name_id);
+			++stream;
+			return;
+		}
+
+		// Decode into the reused scratch buffer, the explicit length keeps embedded '\0's
+		str_buf.assign(start, stream);
+		while (*stream && *stream != '"')
 		{
 			char val{ *stream };
 			if (val == '\n')
@@ -366,18 +375,18 @@ namespace ReVision
 			else if (val == '\\')
 			{
 				++stream;
+				if (!*stream) { break; }
 				val = escape_to_char(*stream);
 				if (val == 0 && *stream != '0')
 				{
 					error_here("Invalid string literal escape '\\%c'", *stream);
 				}
 			}
-			str += val; ++stream;
+			str_buf += val; ++stream;
 		}
-		if (*stream) { assert(*stream == '"'); ++stream; }
-		else { error_here("Unexpected end of file within string literal"); }
-		token.kind = Token::STR;
-		token.str_val = str_intern(str.c_str());
+		if (*stream == '"') { ++stream; }
+		else if (!*stream) { error_here("Unexpected end of file within string literal"); }
+		token.str_val = intern_range(str_buf.data(), str_buf.data() + str_buf.size(), &token.name_id);
 	}
 
 	#define CASE1(c1, k1) \
@@ -396,31 +405,30 @@ namespace ReVision
 		else if (*stream == c3) { token.kind = Token::k3; stream++; } \
 		break;
 
-	void next_token()
+	static_assert(Token::NUM_TOKEN_KINDS <= STATS_MAX_TOKEN_KINDS, "STATS_MAX_TOKEN_KINDS is too small");
+
+	void Lexer::next_token()
 	{
+	#if REVISION_STATS
+		const char *const stream_start{ stream };
+	#endif
 	repeat:
 		token.start = stream;
+		token.pos.offset = static_cast<uint32_t>(stream - lines.text);
 		token.mod = Token::Mod::NONE;
 		switch (*stream)
 		{
 		case ' ': case '\t': case '\n': case '\r': case '\v':
 		{
-			while (isspace(*stream))
-			{
-				if (*stream++ == '\n')
-				{
-					line_start = stream;
-					token.pos.line++;
-				}
-			}
+			stream = scan_kernels.skip_space(stream);
 			goto repeat;
 		}
 		case '\'': { scan_char(); break; }
 		case '"': { scan_str(); break; }
 		case '.':
-			if (isdigit(stream[1]))
+			if (is_digit_char(stream[1]))
 			{
-				scan_float();
+				scan_float(stream);
 			}
 			else if (stream[1] == '.' && stream[2] == '.')
 			{
@@ -435,12 +443,7 @@ namespace ReVision
 			break;
 		case '0':  case '1': case '2': case'3': case '4': case '5': case '6': case '7': case '8': case '9':
 		{
-			while (std::isdigit(*stream)) { stream++; }
-
-			const char c = *stream;
-			stream = token.start;
-			if (c == '.' || std::tolower(c) == 'e') { scan_float(); }
-			else { scan_int(); }
+			scan_number();
 			break;
 		}
 		case 'a': case 'b': case 'c': case 'd': case 'e': case 'f': case 'g': case 'h': case 'i': case 'j':
@@ -450,12 +453,21 @@ namespace ReVision
 		case 'O': case 'P': case 'Q': case 'R': case 'S': case 'T': case 'U': case 'V': case 'W': case 'X':
 		case 'Y': case 'Z': case '_':
 		{
-			while (std::isalnum(*stream) || *stream == '_')
+			stream = scan_kernels.skip_ident(stream + 1);
+			const uint32_t keyword_id{ keyword_id_of(token.start, static_cast<size_t>(stream - token.start)) };
+			if (keyword_id != NUM_KEYWORDS)
 			{
-				++stream;
+				// Keywords were seeded into interns first, so their ids and strings
+				// are fixed and the lookup can be skipped.
+				token.name_id = keyword_id;
+				token.name = intern_str(keyword_id);
+				token.kind = Token::KEYWORD;
+			}
+			else
+			{
+				token.name = intern_range(token.start, stream, &token.name_id);
+				token.kind = Token::NAME;
 			}
-			token.name = str_intern_range(token.start, stream);
-			token.kind = (is_keyword_name(token.name) ? Token::KEYWORD : Token::NAME);
 			break;
 		}
 		case '<':
@@ -501,19 +513,21 @@ namespace ReVision
 				token.kind = Token::DIV_ASSIGN; ++stream;
 			}
 			else if (*stream == '/') {
-				++stream;
-				while (*stream && *stream != '\n')
-				{
-					++stream;
-				}
+				stream = scan_kernels.skip_line(stream + 1);
 				goto repeat;
 			}
 			else if (*stream == '*')
 			{
 				++stream;
 				int level{ 1 };
-				while (*stream && level > 0)
+				while (level > 0)
 				{
+					// Only a '/' or '*' can start "/*" or "*/", so jump straight to the next one
+					stream = scan_kernels.skip_to_comment_delim(stream);
+					if (!*stream)
+					{
+						break;
+					}
 					if (stream[0] == '/' && stream[1] == '*')
 					{
 						++level; stream += 2;
@@ -531,7 +545,10 @@ namespace ReVision
 			}
 			break;
 		}
-		CASE1('\0', Token::END_OF_FILE)
+		case '\0':
+			// Stay on the sentinel, so asking for another token at the end keeps returning END_OF_FILE
+			token.kind = Token::END_OF_FILE;
+			break;
 		CASE1('(', Token::LPAREN)
 		CASE1(')', Token::RPAREN)
 		CASE1('{', Token::LBRACE)
@@ -556,31 +573,38 @@ namespace ReVision
 		CASE3('|', Token::OR, '=', Token::OR_ASSIGN, '|', Token::OR_OR)
 		default:
 		{
-			syntax_error("Invalid '%c' token, skipping", *stream);
+			error_here("Invalid '%c' token, skipping", *stream);
 			stream++;
 			goto repeat;
 		}
 		}
 		token.end = stream;
+		STAT_TOKEN(token.kind);
+		STAT_ADD(STAT_BYTES_LEXED, stream - stream_start);
 	}
 
 	#undef CASE1
 	#undef CASE2
 	#undef CASE3
 
-	void init_stream(const char *name, const char *str)
+	void Lexer::init_stream(const char *name, const char *str)
 	{
-		stream = str;
-		line_start = stream;
-		token.pos.name = name ? name : "<string>";
-		token.pos.line = 1;
+		init_stream_at(name, str, 0);
+	}
+	void Lexer::init_stream_at(const char *name, const char *str, size_t offset)
+	{
+		// Keywords take their strings straight from interns, which must be seeded first
+		init_interns();
+		stream = str + offset;
+		lines.init(name ? name : "<string>", str);
+		token.pos.file = &lines;
 		next_token();
 	}
 
-	bool is_token(Token::Kind kind) { return token.kind == kind; }
-	bool is_token_name(const char *name) { return token.kind == Token::NAME && token.name == name; }
-	bool is_keyword(const char *name) { return is_token(Token::KEYWORD) && token.name == name; }
-	bool match_keyword(const char *name)
+	bool Lexer::is_token(Token::Kind kind) const { return token.kind == kind; }
+	bool Lexer::is_token_name(const char *name) const { return token.kind == Token::NAME && token.name == name; }
+	bool Lexer::is_keyword(const char *name) const { return is_token(Token::KEYWORD) && token.name == name; }
+	bool Lexer::match_keyword(const char *name)
 	{
 		if (is_keyword(name))
 		{
@@ -588,7 +612,7 @@ namespace ReVision
 		}
 		else { return false; }
 	}
-	bool match_token(Token::Kind kind)
+	bool Lexer::match_token(Token::Kind kind)
 	{
 		if (is_token(kind))
 		{
@@ -597,7 +621,7 @@ namespace ReVision
 		}
 		return false;
 	}
-	bool expect_token(Token::Kind kind)
+	bool Lexer::expect_token(Token::Kind kind)
 	{
 		if (is_token(kind))
 		{
@@ -610,4 +634,297 @@ namespace ReVision
 			return false;
 		}
 	}
+
+	const char *token_info() { return default_lexer.token_info(); }
+
+	void scan_int() { default_lexer.scan_int(); }
+	void scan_float() { default_lexer.scan_float(); }
+	void scan_char() { default_lexer.scan_char(); }
+	void scan_str() { default_lexer.scan_str(); }
+
+	void next_token() { default_lexer.next_token(); }
+
+	void init_stream(const char *name, const char *str) { default_lexer.init_stream(name, str); }
+
+	bool is_token(Token::Kind kind) { return default_lexer.is_token(kind); }
+	bool is_token_name(const char *name) { return default_lexer.is_token_name(name); }
+	bool is_keyword(const char *name) { return default_lexer.is_keyword(name); }
+	bool match_keyword(const char *name) { return default_lexer.match_keyword(name); }
+	bool match_token(Token::Kind kind) { return default_lexer.match_token(kind); }
+	bool expect_token(Token::Kind kind) { return default_lexer.expect_token(kind); }
+
+	void TokenBuffer::clear()
+	{
+		kinds.clear();
+		mods.clear();
+		starts.clear();
+		ends.clear();
+		payloads.clear();
+		int_vals.clear();
+		float_vals.clear();
+	}
+	void TokenBuffer::push(const Token &token)
+	{
+		assert(static_cast<size_t>(token.end - text) <= std::numeric_limits<uint32_t>::max());
+		uint32_t payload{ 0 };
+		switch (token.kind)
+		{
+		case Token::INT:
+			payload = static_cast<uint32_t>(int_vals.size());
+			int_vals.push_back(token.int_val);
+			break;
+		case Token::FLOAT:
+			payload = static_cast<uint32_t>(float_vals.size());
+			float_vals.push_back(token.float_val);
+			break;
+		case Token::NAME: case Token::KEYWORD: case Token::STR:
+			payload = token.name_id;
+			break;
+		default:
+			break;
+		}
+		kinds.push_back(static_cast<uint8_t>(token.kind));
+		mods.push_back(static_cast<uint8_t>(token.mod));
+		starts.push_back(static_cast<uint32_t>(token.start - text));
+		ends.push_back(static_cast<uint32_t>(token.end - text));
+		payloads.push_back(payload);
+	}
+	Token TokenBuffer::token_at(size_t i) const
+	{
+		Token token;
+		token.kind = token_cast(kinds[i]);
+		token.mod = static_cast<Token::Mod>(mods[i]);
+		token.pos = SrcPos{ &lines, starts[i] };
+		token.start = text + starts[i];
+		token.end = text + ends[i];
+		token.int_val = 0;
+		switch (token.kind)
+		{
+		case Token::INT: token.int_val = int_vals[payloads[i]]; break;
+		case Token::FLOAT: token.float_val = float_vals[payloads[i]]; break;
+		case Token::NAME: case Token::KEYWORD: case Token::STR: token.name = intern_str(payloads[i]); break;
+		default: break;
+		}
+		token.name_id = payloads[i];
+		return token;
+	}
+	void TokenBuffer::remap_names(const InternRemap &remap)
+	{
+		for (size_t i{ 0 }; i < kinds.size(); ++i)
+		{
+			if (kinds[i] == Token::NAME || kinds[i] == Token::STR)
+			{
+				payloads[i] = remap.resolve(payloads[i]);
+			}
+		}
+	}
+
+	void tokenize_all(Lexer *lexer, const char *name, const char *text, TokenBuffer *buf)
+	{
+		buf->clear();
+		buf->name = name;
+		buf->text = text;
+		lexer->init_stream(name, text);
+		buf->lines.init(lexer->lines.name, text);
+		while (!lexer->is_token(Token::END_OF_FILE))
+		{
+			buf->push(lexer->token);
+			lexer->next_token();
+		}
+		buf->push(lexer->token);
+	}
+
+	// Overwrites [first, last) of dst with src, growing or shrinking dst as needed.
+	template<typename T>
+	static void splice_range(std::vector<T> *dst, size_t first, size_t last, const std::vector<T> &src)
+	{
+		const size_t common{ std::min(last - first, src.size()) };
+		std::copy(src.begin(), src.begin() + static_cast<ptrdiff_t>(common), dst->begin() + static_cast<ptrdiff_t>(first));
+		if (src.size() > common)
+		{
+			dst->insert(dst->begin() + static_cast<ptrdiff_t>(first + common), src.begin() + static_cast<ptrdiff_t>(common), src.end());
+		}
+		else
+		{
+			dst->erase(dst->begin() + static_cast<ptrdiff_t>(first + common), dst->begin() + static_cast<ptrdiff_t>(last));
+		}
+	}
+
+	// Stores the values of middle's tokens of one literal kind in vals, in the slots of
+	// buf's removed tokens [first, old) before appending any. Slots still free then take
+	// the values from the end of vals, so it only ever holds the values of live tokens.
+	template<typename T>
+	static void splice_values(TokenBuffer *buf, size_t first, size_t old, TokenBuffer *middle, Token::Kind kind,
+		std::vector<T> *vals, const std::vector<T> &middle_vals)
+	{
+		std::vector<uint32_t> free_slots;
+		for (size_t i{ first }; i < old; ++i)
+		{
+			if (buf->kinds[i] == kind) { free_slots.push_back(buf->payloads[i]); }
+		}
+		for (size_t i{ 0 }; i < middle->size(); ++i)
+		{
+			if (middle->kinds[i] != kind) { continue; }
+			const T value{ middle_vals[middle->payloads[i]] };
+			if (free_slots.empty())
+			{
+				middle->payloads[i] = static_cast<uint32_t>(vals->size());
+				vals->push_back(value);
+			}
+			else
+			{
+				middle->payloads[i] = free_slots.back();
+				(*vals)[free_slots.back()] = value;
+				free_slots.pop_back();
+			}
+		}
+		if (free_slots.empty())
+		{
+			return;
+		}
+
+		// Fewer values than before: move the live ones past the new end into the free slots below it
+		const size_t new_size{ vals->size() - free_slots.size() };
+		std::vector<uint8_t> tail_free(vals->size() - new_size, 0);
+		std::vector<uint32_t> low_free;
+		for (uint32_t slot : free_slots)
+		{
+			if (slot >= new_size) { tail_free[slot - new_size] = 1; }
+			else { low_free.push_back(slot); }
+		}
+		std::vector<uint32_t> moved_to(tail_free.size(), 0);
+		size_t next_free{ 0 };
+		for (size_t i{ 0 }; i < tail_free.size(); ++i)
+		{
+			if (!tail_free[i])
+			{
+				moved_to[i] = low_free[next_free++];
+				(*vals)[moved_to[i]] = (*vals)[new_size + i];
+			}
+		}
+		assert(next_free == low_free.size());
+		vals->resize(new_size);
+		if (low_free.empty())
+		{
+			return;
+		}
+		auto remap{ [&](const TokenBuffer &tokens, std::vector<uint32_t> *payloads, size_t begin, size_t end)
+		{
+			for (size_t i{ begin }; i < end; ++i)
+			{
+				if (tokens.kinds[i] == kind && (*payloads)[i] >= new_size) { (*payloads)[i] = moved_to[(*payloads)[i] - new_size]; }
+			}
+		} };
+		remap(*buf, &buf->payloads, 0, first);
+		remap(*buf, &buf->payloads, old, buf->size());
+		remap(*middle, &middle->payloads, 0, middle->size());
+	}
+
+	RelexResult relex_edit(Lexer *lexer, TokenBuffer *buf, const char *new_text, const TokenEdit &edit)
+	{
+		assert(buf->size() > 0 && buf->kinds.back() == Token::END_OF_FILE);
+		assert(edit.offset + edit.old_len <= buf->ends.back());
+		const size_t num_old{ buf->size() };
+		const int64_t delta{ static_cast<int64_t>(edit.new_len) - static_cast<int64_t>(edit.old_len) };
+		const uint32_t new_edit_end{ edit.offset + edit.new_len };
+
+		// Keep the tokens whose lookahead stopped short of the edit
+		size_t first{ 0 };
+		if (edit.offset >= RELEX_LOOKAHEAD)
+		{
+			first = static_cast<size_t>(std::upper_bound(buf->ends.begin(), buf->ends.end(), edit.offset - RELEX_LOOKAHEAD) - buf->ends.begin());
+		}
+		const uint32_t restart{ first ? buf->ends[first - 1] : 0 };
+
+		TokenBuffer middle;
+		middle.name = buf->name;
+		middle.text = new_text;
+		lexer->init_stream_at(buf->lines.name, new_text, restart);
+		size_t old{ first };
+		for (;;)
+		{
+			const uint32_t start{ static_cast<uint32_t>(lexer->token.start - new_text) };
+			if (start >= new_edit_end)
+			{
+				// Same bytes from here on, so if an old token started here the rest matches too
+				const int64_t old_start{ static_cast<int64_t>(start) - delta };
+				while (old < num_old && buf->starts[old] < old_start) { ++old; }
+				if (old < num_old && buf->starts[old] == old_start)
+				{
+					break;
+				}
+			}
+			middle.push(lexer->token);
+			if (lexer->is_token(Token::END_OF_FILE))
+			{
+				old = num_old;
+				break;
+			}
+			lexer->next_token();
+		}
+
+		// Literal payloads of the new tokens index middle's side arrays, move them into buf's
+		splice_values(buf, first, old, &middle, Token::INT, &buf->int_vals, middle.int_vals);
+		splice_values(buf, first, old, &middle, Token::FLOAT, &buf->float_vals, middle.float_vals);
+		for (size_t i{ old }; i < num_old; ++i)
+		{
+			buf->starts[i] = static_cast<uint32_t>(buf->starts[i] + delta);
+			buf->ends[i] = static_cast<uint32_t>(buf->ends[i] + delta);
+		}
+		splice_range(&buf->kinds, first, old, middle.kinds);
+		splice_range(&buf->mods, first, old, middle.mods);
+		splice_range(&buf->starts, first, old, middle.starts);
+		splice_range(&buf->ends, first, old, middle.ends);
+		splice_range(&buf->payloads, first, old, middle.payloads);
+		buf->text = new_text;
+		buf->lines.init(buf->lines.name, new_text);
+		return RelexResult{ first, old - first, middle.size() };
+	}
+
+	void TokenCursor::next_token()
+	{
+		// The END_OF_FILE token is sticky, just like Lexer::next_token at the end of the stream
+		if (index + 1 < buf->size())
+		{
+			++index;
+		}
+	}
+	const char *TokenCursor::token_info() const
+	{
+		if (kind() == Token::NAME || kind() == Token::KEYWORD) { return name(); }
+		else { return token_kind_name(kind()); }
+	}
+	bool TokenCursor::is_token(Token::Kind kind) const { return this->kind() == kind; }
+	bool TokenCursor::is_token_name(const char *name) const { return kind() == Token::NAME && this->name() == name; }
+	bool TokenCursor::is_keyword(const char *name) const { return kind() == Token::KEYWORD && this->name() == name; }
+	bool TokenCursor::match_keyword(const char *name)
+	{
+		if (is_keyword(name))
+		{
+			next_token(); return true;
+		}
+		else { return false; }
+	}
+	bool TokenCursor::match_token(Token::Kind kind)
+	{
+		if (is_token(kind))
+		{
+			next_token();
+			return true;
+		}
+		return false;
+	}
+	bool TokenCursor::expect_token(Token::Kind kind)
+	{
+		if (is_token(kind))
+		{
+			next_token();
+			return true;
+		}
+		else
+		{
+			fatal_error(pos(), "expected token %s, got %s", token_kind_name(token_cast(kind)), token_info());
+			return false;
+		}
+	}
 }
\ No newline at end of file
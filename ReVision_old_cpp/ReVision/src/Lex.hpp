@@ -1,5 +1,7 @@
 #pragma once
 #include "Common.hpp"
+#include "Keywords.hpp"
+#include "Simd.hpp"
 
 namespace ReVision
 {
@@ -36,8 +38,6 @@ namespace ReVision
 	// extern const char *delete_keyword;
 
 
-	extern const char *first_keyword;
-	extern const char *last_keyword;
 	extern std::vector<const char *> keywords;
 
 	extern const char *always_name;
@@ -50,12 +50,40 @@ namespace ReVision
 	void init_keywords();
 
 	bool is_keyword_name(const char *name);
+	inline bool is_keyword_id(InternId id) { return id < NUM_KEYWORDS; }
 
-	struct SrcPos
+	// A resolved position, only built when a diagnostic needs one.
+	struct SrcLoc
 	{
 		const char *name;
 		int line;
+		// Counted in bytes, a tab is one column
+		int col;
+	};
+
+	// The start offset of every line in a source text, found with one find_newlines
+	// pass the first time a position in it gets resolved. Not thread safe, the
+	// thread that lexes a text is the one reporting errors in it.
+	struct LineTable
+	{
+		const char *name;
+		const char *text;
+		// Where text[0] sits in its file, past 1,1 when text is a window of a stream
+		int first_line;
+		int first_col;
+		mutable std::vector<uint32_t> line_starts;
+
+		void init(const char *name, const char *text);
+		SrcLoc resolve(uint32_t offset) const;
+	};
+
+	// Tokens only carry the byte offset, file is nullptr for builtins.
+	struct SrcPos
+	{
+		const LineTable *file;
+		uint32_t offset;
 	};
+	SrcLoc resolve_pos(SrcPos pos);
 
 	struct Token
 	{
@@ -142,6 +170,9 @@ namespace ReVision
 		SrcPos pos;
 		const char *start;
 		const char *end;
+		// Set for NAME, KEYWORD and STR, provisional while lexing on worker threads.
+		// intern_len(name_id) is the length of a STR, which may contain '\0'.
+		InternId name_id;
 
 		union
 		{
@@ -153,9 +184,6 @@ namespace ReVision
 	};
 
 	extern SrcPos pos_builtin;
-	extern Token token;
-	extern const char *stream;
-	extern const char *line_start;
 
 	template<typename T>
 	static inline Token::Kind token_cast(T kind)
@@ -164,15 +192,57 @@ namespace ReVision
 	}
 
 	const char *token_kind_name(Token::Kind kind);
-	const char *token_info();
 
 	void warning(SrcPos pos, const char *fmt, ...);
 	void error(SrcPos pos, const char *fmt, ...);
 
 	uint8_t char_to_digit(char c);
+	char escape_to_char(char c);
+
+	// Owns all the state needed to lex one stream, so independent streams
+	// can be lexed side by side or on different threads.
+	struct Lexer
+	{
+		Token token;
+		const char *stream;
+		LineTable lines;
+		// Lexers running on worker threads must use str_intern_range_concurrent.
+		const char *(*intern_range)(const char *start, const char *end, InternId *id) = str_intern_range;
+		// Scratch space for string literals with escapes, kept to avoid reallocating.
+		std::string str_buf;
+
+		void init_stream(const char *name, const char *str);
+		// Starts lexing str at offset, which must be between two tokens.
+		void init_stream_at(const char *name, const char *str, size_t offset);
+		void next_token();
+
+		void scan_int();
+		void scan_float();
+		// digits_end is the end of the decimal digit run starting at stream.
+		void scan_int(const char *digits_end);
+		void scan_float(const char *digits_end);
+		void scan_number();
+		void scan_char();
+		void scan_str();
+
+		const char *token_info() const;
+		bool is_token(Token::Kind kind) const;
+		bool is_token_name(const char *name) const;
+		bool is_keyword(const char *name) const;
+		bool match_keyword(const char *name);
+		bool match_token(Token::Kind kind);
+		bool expect_token(Token::Kind kind);
+	};
+
+	// The free functions below operate on default_lexer.
+	extern Lexer default_lexer;
+	extern Token &token;
+	extern const char *&stream;
+
+	const char *token_info();
+
 	void scan_int();
 	void scan_float();
-	char escape_to_char(char c);
 	void scan_char();
 	void scan_str();
 
@@ -186,4 +256,87 @@ namespace ReVision
 	bool match_keyword(const char *name);
 	bool match_token(Token::Kind kind);
 	bool expect_token(Token::Kind kind);
+
+	// A whole file worth of tokens in structure-of-arrays form. Only the
+	// kind, modifier and offsets are stored per token, literal values live
+	// in side arrays indexed by payloads[i].
+	struct TokenBuffer
+	{
+		const char *name;
+		const char *text;
+		std::vector<uint8_t> kinds;
+		std::vector<uint8_t> mods;
+		std::vector<uint32_t> starts;
+		std::vector<uint32_t> ends;
+		// INT: int_vals index, FLOAT: float_vals index, NAME/KEYWORD/STR: InternId, 0 otherwise
+		std::vector<uint32_t> payloads;
+		std::vector<uint64_t> int_vals;
+		std::vector<double> float_vals;
+		LineTable lines;
+
+		size_t size() const { return kinds.size(); }
+		void clear();
+		void push(const Token &token);
+		// Replaces the provisional ids of a buffer lexed on a worker thread.
+		void remap_names(const InternRemap &remap);
+		// Rebuilds the full Token, mostly for diagnostics and tests.
+		Token token_at(size_t i) const;
+	};
+
+	// Lexes text up to and including its END_OF_FILE token.
+	void tokenize_all(Lexer *lexer, const char *name, const char *text, TokenBuffer *buf);
+
+	// Replaces old_len bytes at offset in the text a buffer was lexed from with new_len bytes.
+	struct TokenEdit
+	{
+		uint32_t offset;
+		uint32_t old_len;
+		uint32_t new_len;
+	};
+	struct RelexResult
+	{
+		// Tokens [first, first + num_inserted) are new, they replaced num_removed old ones
+		size_t first;
+		size_t num_removed;
+		size_t num_inserted;
+	};
+	// Farthest the lexer looks past the end of a token to decide where it ends, e.g. "..", "1e"
+	#define RELEX_LOOKAHEAD 4
+	// Updates buf, lexed from the text before the edit, to the tokens of new_text.
+	// Lexing restarts at the end of the last token that can't have seen the edit and stops
+	// at the first new token past the edit that starts where an old one did, everything
+	// from there on lexes the same. Tokens outside that window keep their payloads and
+	// interned names, only their offsets shift. Lexer state between tokens is just the
+	// position, so comments and strings opened or closed by the edit need no special care.
+	// New literal values take the slots of the replaced ones in int_vals and float_vals,
+	// which hold only the values of live tokens, so edits never grow them past that.
+	RelexResult relex_edit(Lexer *lexer, TokenBuffer *buf, const char *new_text, const TokenEdit &edit);
+
+	// Walks a TokenBuffer with the same interface the Lexer offers.
+	struct TokenCursor
+	{
+		explicit TokenCursor(const TokenBuffer *buf)
+			: buf(buf), index(0)
+		{}
+
+		const TokenBuffer *buf;
+		size_t index;
+
+		Token::Kind kind() const { return token_cast(buf->kinds[index]); }
+		InternId name_id() const { return buf->payloads[index]; }
+		const char *name() const { return intern_str(buf->payloads[index]); }
+		const char *str_val() const { return intern_str(buf->payloads[index]); }
+		uint64_t int_val() const { return buf->int_vals[buf->payloads[index]]; }
+		double float_val() const { return buf->float_vals[buf->payloads[index]]; }
+		SrcPos pos() const { return SrcPos{ &buf->lines, buf->starts[index] }; }
+
+		void next_token();
+		const char *token_info() const;
+		bool is_token(Token::Kind kind) const;
+		bool is_token_name(const char *name) const;
+		bool is_keyword(const char *name) const;
+		bool match_keyword(const char *name);
+		bool match_token(Token::Kind kind);
+		bool expect_token(Token::Kind kind);
+	};
 }
\ No newline at end of file
@@ -0,0 +1,777 @@
+#include "Parse.hpp"
+
+namespace ReVision
+{
+	#define fatal_error_here(...) (error(token().pos, __VA_ARGS__), exit(1))
+
+	void Parser::init(const char *name, const char *text, Ast *ast)
+	{
+		this->ast = ast;
+		ast->clear();
+		frames.clear();
+		scratch.clear();
+		lexer.init_stream(name, text);
+		ast->lines.init(lexer.lines.name, text);
+		ring.init(lexer.token);
+	}
+
+	void TokenRing::init(const Token &first)
+	{
+		tokens[0] = first;
+		head = 0;
+		count = 1;
+	}
+
+	const char *Parser::token_info() const
+	{
+		if (token().kind == Token::NAME || token().kind == Token::KEYWORD) { return token().name; }
+		else { return token_kind_name(token().kind); }
+	}
+	bool Parser::match_token(Token::Kind kind)
+	{
+		if (is_token(kind))
+		{
+			next_token();
+			return true;
+		}
+		return false;
+	}
+	bool Parser::match_keyword(const char *name)
+	{
+		if (is_keyword(name))
+		{
+			next_token();
+			return true;
+		}
+		return false;
+	}
+	bool Parser::expect_token(Token::Kind kind)
+	{
+		if (is_token(kind))
+		{
+			next_token();
+			return true;
+		}
+		fatal_error_here("expected token %s, got %s", token_kind_name(kind), token_info());
+		return false;
+	}
+
+	InternId Parser::expect_name()
+	{
+		const InternId id{ token().name_id };
+		expect_token(Token::NAME);
+		return id;
+	}
+
+	ListId Parser::end_list(size_t scratch_start)
+	{
+		const ListId list{ ast->add_list(scratch.data() + scratch_start, scratch.size() - scratch_start) };
+		scratch.resize(scratch_start);
+		return list;
+	}
+
+	TypespecId Parser::parse_typespec()
+	{
+		const uint32_t start_offset{ offset() };
+		TypespecId type{ NULL_AST_ID };
+		if (is_token(Token::NAME))
+		{
+			type = ast->add_typespec(TYPESPEC_NAME, start_offset, token().name_id);
+			next_token();
+		}
+		else if (match_keyword(func_keyword))
+		{
+			expect_token(Token::LPAREN);
+			const size_t params{ scratch.size() };
+			if (!is_token(Token::RPAREN))
+			{
+				do
+				{
+					const TypespecId param{ parse_typespec() };
+					scratch.push_back(param);
+				} while (match_token(Token::COMMA));
+			}
+			expect_token(Token::RPAREN);
+			const uint32_t count{ static_cast<uint32_t>(scratch.size() - params) };
+			const ListId list{ end_list(params) };
+			const TypespecId ret{ match_token(Token::COLON) ? parse_typespec() : NULL_AST_ID };
+			type = ast->add_typespec(TYPESPEC_FUNC, start_offset, list, count, ret);
+		}
+		else if (match_token(Token::LPAREN))
+		{
+			type = parse_typespec();
+			expect_token(Token::RPAREN);
+		}
+		else
+		{
+			fatal_error_here("Unexpected token %s in type", token_info());
+		}
+
+		while (true)
+		{
+			if (match_token(Token::MUL))
+			{
+				type = ast->add_typespec(TYPESPEC_PTR, start_offset, type);
+			}
+			else if (match_keyword(const_keyword))
+			{
+				type = ast->add_typespec(TYPESPEC_CONST, start_offset, type);
+			}
+			else if (match_token(Token::LBRACKET))
+			{
+				const ExprId size{ is_token(Token::RBRACKET) ? NULL_AST_ID : parse_expr() };
+				expect_token(Token::RBRACKET);
+				type = ast->add_typespec(TYPESPEC_ARRAY, start_offset, type, size);
+			}
+			else
+			{
+				return type;
+			}
+		}
+	}
+
+	// Pratt parsing without recursion: instead of calling itself for the right
+	// hand side of an operator, parse_expr pushes a frame and loops back to parse
+	// the next operand. A frame is reduced once the next infix operator doesn't
+	// bind tighter than the frame's minimum binding power, or its closing token shows up.
+	ExprId Parser::parse_expr()
+	{
+		const size_t base{ frames.size() };
+		ExprId lhs{ NULL_AST_ID };
+
+	operand:
+		while (true)
+		{
+			const Token::Kind op{ kind() };
+			if (is_unary_op(op) || op == Token::INC || op == Token::DEC)
+			{
+				frames.push_back(ExprFrame{ ExprFrame::UNARY, static_cast<uint8_t>(op), UNARY_BINDING_POWER, offset(), 0, 0 });
+				next_token();
+			}
+			else if (op == Token::LPAREN)
+			{
+				frames.push_back(ExprFrame{ ExprFrame::PAREN, 0, 0, offset(), 0, 0 });
+				next_token();
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		switch (kind())
+		{
+		case Token::INT:
+			lhs = ast->add_int(offset(), token().int_val);
+			next_token();
+			break;
+		case Token::FLOAT:
+			lhs = ast->add_float(offset(), token().float_val);
+			next_token();
+			break;
+		case Token::STR:
+			lhs = ast->add_expr(EXPR_STR, offset(), token().name_id);
+			next_token();
+			break;
+		case Token::NAME:
+		{
+			const uint32_t name_offset{ offset() };
+			const InternId name{ token().name_id };
+			next_token();
+			if (!is_token(Token::LBRACE))
+			{
+				lhs = ast->add_expr(EXPR_NAME, name_offset, name);
+				break;
+			}
+			// Name{...} compound literal
+			const TypespecId type{ ast->add_typespec(TYPESPEC_NAME, name_offset, name) };
+			next_token();
+			if (match_token(Token::RBRACE))
+			{
+				lhs = ast->add_expr(EXPR_COMPOUND, name_offset, type, 0, 0);
+				break;
+			}
+			frames.push_back(ExprFrame{ ExprFrame::COMPOUND, 0, 0, name_offset, type, static_cast<uint32_t>(scratch.size()) });
+			goto operand;
+		}
+		case Token::LBRACE:
+		{
+			const uint32_t brace_offset{ offset() };
+			next_token();
+			if (match_token(Token::RBRACE))
+			{
+				lhs = ast->add_expr(EXPR_COMPOUND, brace_offset, NULL_AST_ID, 0, 0);
+				break;
+			}
+			frames.push_back(ExprFrame{ ExprFrame::COMPOUND, 0, 0, brace_offset, NULL_AST_ID, static_cast<uint32_t>(scratch.size()) });
+			goto operand;
+		}
+		case Token::KEYWORD:
+		{
+			const uint32_t keyword_offset{ offset() };
+			const InternId keyword{ token().name_id };
+			if (keyword == offsetof_keyword_id)
+			{
+				next_token();
+				expect_token(Token::LPAREN);
+				const TypespecId type{ parse_typespec() };
+				expect_token(Token::COMMA);
+				const InternId field{ expect_name() };
+				expect_token(Token::RPAREN);
+				lhs = ast->add_expr(EXPR_OFFSETOF, keyword_offset, type, field);
+				break;
+			}
+			ExprKind expr_kind{ EXPR_SIZEOF_EXPR }, type_kind{ EXPR_SIZEOF_TYPE };
+			if (keyword == alignof_keyword_id) { expr_kind = EXPR_ALIGNOF_EXPR; type_kind = EXPR_ALIGNOF_TYPE; }
+			else if (keyword == typeof_keyword_id) { expr_kind = EXPR_TYPEOF_EXPR; type_kind = EXPR_TYPEOF_TYPE; }
+			else if (keyword != sizeof_keyword_id)
+			{
+				fatal_error_here("Unexpected keyword %s in expression", token_info());
+			}
+			next_token();
+			expect_token(Token::LPAREN);
+			// sizeof(:type) or sizeof(expr)
+			if (match_token(Token::COLON))
+			{
+				lhs = ast->add_expr(type_kind, keyword_offset, parse_typespec());
+				expect_token(Token::RPAREN);
+				break;
+			}
+			frames.push_back(ExprFrame{ ExprFrame::SIZEOF, static_cast<uint8_t>(expr_kind), 0, keyword_offset, 0, 0 });
+			goto operand;
+		}
+		default:
+			fatal_error_here("Unexpected token %s in expression", token_info());
+		}
+
+	postfix:
+		while (true)
+		{
+			const uint32_t op_offset{ offset() };
+			if (match_token(Token::LPAREN))
+			{
+				if (match_token(Token::RPAREN))
+				{
+					lhs = ast->add_expr(EXPR_CALL, op_offset, lhs, 0, 0);
+					continue;
+				}
+				frames.push_back(ExprFrame{ ExprFrame::CALL, 0, 0, op_offset, lhs, static_cast<uint32_t>(scratch.size()) });
+				goto operand;
+			}
+			else if (match_token(Token::LBRACKET))
+			{
+				frames.push_back(ExprFrame{ ExprFrame::INDEX, 0, 0, op_offset, lhs, 0 });
+				goto operand;
+			}
+			else if (match_token(Token::DOT))
+			{
+				lhs = ast->add_expr(EXPR_FIELD, op_offset, lhs, expect_name());
+			}
+			else if (is_token(Token::INC) || is_token(Token::DEC))
+			{
+				lhs = ast->add_expr(EXPR_MODIFY, op_offset, lhs, 0, 0, static_cast<uint8_t>(kind()), AST_POSTFIX);
+				next_token();
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		while (true)
+		{
+			const Token::Kind op{ kind() };
+			const uint8_t binding_power{ binding_power_table.infix[op] };
+			const uint8_t min_binding_power{ frames.size() > base ? frames.back().min_binding_power : static_cast<uint8_t>(0) };
+			if (binding_power > min_binding_power)
+			{
+				// Pushing the frame with the operator's own binding power makes operators of the
+				// same precedence reduce first, which is left associativity. The ternary parses both
+				// of its branches at 0, which makes it right associative.
+				const ExprFrame::Kind frame_kind{ op == Token::QUESTION ? ExprFrame::TERNARY_THEN : ExprFrame::BINARY };
+				const uint8_t frame_binding_power{ op == Token::QUESTION ? static_cast<uint8_t>(0) : binding_power };
+				frames.push_back(ExprFrame{ frame_kind, static_cast<uint8_t>(op), frame_binding_power, offset(), lhs, 0 });
+				next_token();
+				goto operand;
+			}
+			if (frames.size() == base)
+			{
+				return lhs;
+			}
+
+			const ExprFrame frame{ frames.back() };
+			switch (frame.kind)
+			{
+			case ExprFrame::BINARY:
+				lhs = ast->add_expr(EXPR_BINARY, frame.offset, frame.lhs, lhs, 0, frame.op);
+				frames.pop_back();
+				break;
+			case ExprFrame::UNARY:
+				if (frame.op == Token::INC || frame.op == Token::DEC)
+				{
+					lhs = ast->add_expr(EXPR_MODIFY, frame.offset, lhs, 0, 0, frame.op);
+				}
+				else
+				{
+					lhs = ast->add_expr(EXPR_UNARY, frame.offset, lhs, 0, 0, frame.op);
+				}
+				frames.pop_back();
+				break;
+			case ExprFrame::PAREN:
+				expect_token(Token::RPAREN);
+				frames.pop_back();
+				goto postfix;
+			case ExprFrame::INDEX:
+				expect_token(Token::RBRACKET);
+				lhs = ast->add_expr(EXPR_INDEX, frame.offset, frame.lhs, lhs);
+				frames.pop_back();
+				goto postfix;
+			case ExprFrame::SIZEOF:
+				expect_token(Token::RPAREN);
+				lhs = ast->add_expr(static_cast<ExprKind>(frame.op), frame.offset, lhs);
+				frames.pop_back();
+				goto postfix;
+			case ExprFrame::CALL:
+			case ExprFrame::COMPOUND:
+			{
+				scratch.push_back(lhs);
+				const Token::Kind close{ frame.kind == ExprFrame::CALL ? Token::RPAREN : Token::RBRACE };
+				// Compound literals allow a trailing comma
+				if (match_token(Token::COMMA) && !(frame.kind == ExprFrame::COMPOUND && is_token(close)))
+				{
+					goto operand;
+				}
+				expect_token(close);
+				const uint32_t count{ static_cast<uint32_t>(scratch.size() - frame.extra) };
+				const ListId list{ end_list(frame.extra) };
+				lhs = ast->add_expr(frame.kind == ExprFrame::CALL ? EXPR_CALL : EXPR_COMPOUND, frame.offset, frame.lhs, list, count);
+				frames.pop_back();
+				goto postfix;
+			}
+			case ExprFrame::TERNARY_THEN:
+				expect_token(Token::COLON);
+				frames.back().kind = ExprFrame::TERNARY_ELSE;
+				frames.back().extra = lhs;
+				goto operand;
+			case ExprFrame::TERNARY_ELSE:
+				lhs = ast->add_expr(EXPR_TERNARY, frame.offset, frame.lhs, frame.extra, lhs);
+				frames.pop_back();
+				break;
+			}
+		}
+	}
+
+	ExprId Parser::parse_paren_expr()
+	{
+		expect_token(Token::LPAREN);
+		const ExprId expr{ parse_expr() };
+		expect_token(Token::RPAREN);
+		return expr;
+	}
+
+	StmtId Parser::parse_block()
+	{
+		const uint32_t block_offset{ offset() };
+		expect_token(Token::LBRACE);
+		const size_t stmts{ scratch.size() };
+		while (!is_token(Token::RBRACE) && !is_token(Token::END_OF_FILE))
+		{
+			const StmtId stmt{ parse_stmt() };
+			if (stmt) { scratch.push_back(stmt); }
+		}
+		expect_token(Token::RBRACE);
+		const uint32_t count{ static_cast<uint32_t>(scratch.size() - stmts) };
+		return ast->add_stmt(STMT_BLOCK, block_offset, end_list(stmts), count);
+	}
+
+	// x := expr, x: type = expr, lhs op= rhs or a plain expression. No trailing ';',
+	// so for loops can use it for their init and next parts.
+	StmtId Parser::parse_simple_stmt()
+	{
+		const uint32_t stmt_offset{ offset() };
+		if (is_token(Token::NAME))
+		{
+			const Token::Kind next{ peek_token(1).kind };
+			if (next == Token::COLON_ASSIGN)
+			{
+				const InternId name{ expect_name() };
+				next_token();
+				return ast->add_stmt(STMT_INIT, stmt_offset, name, NULL_AST_ID, parse_expr());
+			}
+			if (next == Token::COLON)
+			{
+				const InternId name{ expect_name() };
+				next_token();
+				const TypespecId type{ parse_typespec() };
+				const ExprId init{ match_token(Token::ASSIGN) ? parse_expr() : NULL_AST_ID };
+				return ast->add_stmt(STMT_INIT, stmt_offset, name, type, init);
+			}
+		}
+		const ExprId expr{ parse_expr() };
+		if (is_assign_op(kind()))
+		{
+			const Token::Kind op{ kind() };
+			next_token();
+			return ast->add_stmt(STMT_ASSIGN, stmt_offset, expr, parse_expr(), 0, static_cast<uint8_t>(op));
+		}
+		return ast->add_stmt(STMT_EXPR, stmt_offset, expr);
+	}
+
+	StmtId Parser::parse_if()
+	{
+		const uint32_t if_offset{ offset() };
+		const ExprId cond{ parse_paren_expr() };
+		const StmtId then_stmt{ parse_stmt() };
+		StmtId else_stmt{ NULL_AST_ID };
+		if (match_keyword(else_keyword))
+		{
+			// else if chains nest as the else branch, only the condition needs its own node
+			else_stmt = match_keyword(if_keyword) ? parse_if() : parse_stmt();
+		}
+		return ast->add_stmt(STMT_IF, if_offset, cond, then_stmt, else_stmt);
+	}
+
+	StmtId Parser::parse_switch()
+	{
+		const uint32_t switch_offset{ offset() };
+		const ExprId expr{ parse_paren_expr() };
+		expect_token(Token::LBRACE);
+		const size_t cases{ scratch.size() };
+		while (!is_token(Token::RBRACE) && !is_token(Token::END_OF_FILE))
+		{
+			const uint32_t case_offset{ offset() };
+			uint16_t flags{ 0 };
+			const size_t exprs{ scratch.size() };
+			if (match_keyword(default_keyword))
+			{
+				flags = AST_DEFAULT;
+			}
+			else
+			{
+				if (!match_keyword(case_keyword))
+				{
+					fatal_error_here("Expected case or default in switch, got %s", token_info());
+				}
+				do
+				{
+					const ExprId label{ parse_expr() };
+					scratch.push_back(label);
+				} while (match_token(Token::COMMA));
+			}
+			expect_token(Token::COLON);
+			const uint32_t num_exprs{ static_cast<uint32_t>(scratch.size() - exprs) };
+			const ListId expr_list{ end_list(exprs) };
+
+			const uint32_t body_offset{ offset() };
+			const size_t stmts{ scratch.size() };
+			while (!is_keyword(case_keyword) && !is_keyword(default_keyword) && !is_token(Token::RBRACE) && !is_token(Token::END_OF_FILE))
+			{
+				const StmtId stmt{ parse_stmt() };
+				if (stmt) { scratch.push_back(stmt); }
+			}
+			const uint32_t num_stmts{ static_cast<uint32_t>(scratch.size() - stmts) };
+			const StmtId body{ ast->add_stmt(STMT_BLOCK, body_offset, end_list(stmts), num_stmts) };
+			scratch.push_back(ast->add_stmt(STMT_CASE, case_offset, expr_list, num_exprs, body, 0, flags));
+		}
+		expect_token(Token::RBRACE);
+		const uint32_t count{ static_cast<uint32_t>(scratch.size() - cases) };
+		return ast->add_stmt(STMT_SWITCH, switch_offset, expr, end_list(cases), count);
+	}
+
+	StmtId Parser::parse_stmt()
+	{
+		const uint32_t stmt_offset{ offset() };
+		if (is_token(Token::LBRACE))
+		{
+			return parse_block();
+		}
+		if (match_token(Token::SEMICOLON))
+		{
+			return NULL_AST_ID;
+		}
+		if (match_token(Token::COLON))
+		{
+			return ast->add_stmt(STMT_LABEL, stmt_offset, expect_name());
+		}
+		if (is_token(Token::KEYWORD))
+		{
+			const InternId keyword{ token().name_id };
+			StmtId stmt{ NULL_AST_ID };
+			switch (keyword)
+			{
+			case if_keyword_id:
+				next_token();
+				return parse_if();
+			case while_keyword_id:
+			{
+				next_token();
+				const ExprId cond{ parse_paren_expr() };
+				return ast->add_stmt(STMT_WHILE, stmt_offset, cond, parse_stmt());
+			}
+			case do_keyword_id:
+			{
+				next_token();
+				const StmtId body{ parse_stmt() };
+				if (!match_keyword(while_keyword))
+				{
+					fatal_error_here("Expected while after do body, got %s", token_info());
+				}
+				stmt = ast->add_stmt(STMT_DO_WHILE, stmt_offset, parse_paren_expr(), body);
+				break;
+			}
+			case for_keyword_id:
+			{
+				next_token();
+				expect_token(Token::LPAREN);
+				uint32_t parts[4]{ NULL_AST_ID, NULL_AST_ID, NULL_AST_ID, NULL_AST_ID };
+				if (!is_token(Token::SEMICOLON)) { parts[0] = parse_simple_stmt(); }
+				expect_token(Token::SEMICOLON);
+				if (!is_token(Token::SEMICOLON)) { parts[1] = parse_expr(); }
+				expect_token(Token::SEMICOLON);
+				if (!is_token(Token::RPAREN)) { parts[2] = parse_simple_stmt(); }
+				expect_token(Token::RPAREN);
+				parts[3] = parse_stmt();
+				return ast->add_stmt(STMT_FOR, stmt_offset, ast->add_list(parts, 4));
+			}
+			case switch_keyword_id:
+				next_token();
+				return parse_switch();
+			case return_keyword_id:
+				next_token();
+				stmt = ast->add_stmt(STMT_RETURN, stmt_offset, is_token(Token::SEMICOLON) ? NULL_AST_ID : parse_expr());
+				break;
+			case break_keyword_id:
+				next_token();
+				stmt = ast->add_stmt(STMT_BREAK, stmt_offset);
+				break;
+			case continue_keyword_id:
+				next_token();
+				stmt = ast->add_stmt(STMT_CONTINUE, stmt_offset);
+				break;
+			case jmp_keyword_id:
+				next_token();
+				stmt = ast->add_stmt(STMT_JMP, stmt_offset, expect_name());
+				break;
+			default:
+				if (is_decl_start())
+				{
+					return ast->add_stmt(STMT_DECL, stmt_offset, parse_decl());
+				}
+				stmt = parse_simple_stmt();
+				break;
+			}
+			expect_token(Token::SEMICOLON);
+			return stmt;
+		}
+		const StmtId stmt{ parse_simple_stmt() };
+		expect_token(Token::SEMICOLON);
+		return stmt;
+	}
+
+	bool Parser::is_decl_start()
+	{
+		if (is_token(Token::KEYWORD))
+		{
+			switch (token().name_id)
+			{
+			case const_keyword_id:
+			case typedef_keyword_id:
+			case struct_keyword_id:
+			case union_keyword_id:
+			case enum_keyword_id:
+			case func_keyword_id:
+			case import_keyword_id:
+				return true;
+			}
+			return false;
+		}
+		return is_token(Token::NAME) && (peek_token(1).kind == Token::COLON || peek_token(1).kind == Token::COLON_ASSIGN);
+	}
+
+	DeclId Parser::parse_aggregate(DeclKind kind)
+	{
+		const uint32_t decl_offset{ offset() };
+		const InternId name{ expect_name() };
+		expect_token(Token::LBRACE);
+		const size_t fields{ scratch.size() };
+		while (!is_token(Token::RBRACE) && !is_token(Token::END_OF_FILE))
+		{
+			// x, y: float;
+			const size_t names{ scratch.size() };
+			do
+			{
+				const InternId field{ expect_name() };
+				scratch.push_back(field);
+				scratch.push_back(NULL_AST_ID);
+			} while (match_token(Token::COMMA));
+			expect_token(Token::COLON);
+			const TypespecId type{ parse_typespec() };
+			for (size_t i{ names + 1 }; i < scratch.size(); i += 2)
+			{
+				scratch[i] = type;
+			}
+			expect_token(Token::SEMICOLON);
+		}
+		expect_token(Token::RBRACE);
+		const uint32_t count{ static_cast<uint32_t>((scratch.size() - fields) / 2) };
+		return ast->add_decl(kind, decl_offset, name, end_list(fields), count);
+	}
+
+	DeclId Parser::parse_enum()
+	{
+		const uint32_t decl_offset{ offset() };
+		const InternId name{ is_token(Token::NAME) ? expect_name() : INVALID_INTERN_ID };
+		expect_token(Token::LBRACE);
+		const size_t items{ scratch.size() };
+		while (!is_token(Token::RBRACE) && !is_token(Token::END_OF_FILE))
+		{
+			const InternId item{ expect_name() };
+			scratch.push_back(item);
+			scratch.push_back(match_token(Token::ASSIGN) ? parse_expr() : NULL_AST_ID);
+			if (!match_token(Token::COMMA))
+			{
+				break;
+			}
+		}
+		expect_token(Token::RBRACE);
+		const uint32_t count{ static_cast<uint32_t>((scratch.size() - items) / 2) };
+		return ast->add_decl(DECL_ENUM, decl_offset, name, end_list(items), count);
+	}
+
+	DeclId Parser::parse_func()
+	{
+		const uint32_t decl_offset{ offset() };
+		const InternId name{ expect_name() };
+		expect_token(Token::LPAREN);
+		const size_t params{ scratch.size() };
+		// Return type, body and parameter count are filled in once known
+		scratch.insert(scratch.end(), 3, NULL_AST_ID);
+		uint16_t flags{ 0 };
+		if (!is_token(Token::RPAREN))
+		{
+			do
+			{
+				if (match_token(Token::ELLIPSIS))
+				{
+					flags |= AST_VARIADIC;
+					break;
+				}
+				const InternId param{ expect_name() };
+				expect_token(Token::COLON);
+				const TypespecId type{ parse_typespec() };
+				scratch.push_back(param);
+				scratch.push_back(type);
+			} while (match_token(Token::COMMA));
+		}
+		expect_token(Token::RPAREN);
+		scratch[params + 2] = static_cast<uint32_t>((scratch.size() - params - 3) / 2);
+		if (match_token(Token::COLON))
+		{
+			const TypespecId ret{ parse_typespec() };
+			scratch[params] = ret;
+		}
+		if (!match_token(Token::SEMICOLON))
+		{
+			const StmtId body{ parse_block() };
+			scratch[params + 1] = body;
+		}
+		return ast->add_decl(DECL_FUNC, decl_offset, name, end_list(params), 0, flags);
+	}
+
+	// x: type = expr; or x := expr;
+	DeclId Parser::parse_var()
+	{
+		const uint32_t decl_offset{ offset() };
+		const InternId name{ expect_name() };
+		TypespecId type{ NULL_AST_ID };
+		ExprId init{ NULL_AST_ID };
+		if (match_token(Token::COLON_ASSIGN))
+		{
+			init = parse_expr();
+		}
+		else
+		{
+			expect_token(Token::COLON);
+			type = parse_typespec();
+			if (match_token(Token::ASSIGN)) { init = parse_expr(); }
+		}
+		expect_token(Token::SEMICOLON);
+		return ast->add_decl(DECL_VAR, decl_offset, name, type, init);
+	}
+
+	DeclId Parser::parse_decl()
+	{
+		const uint32_t decl_offset{ offset() };
+		if (is_token(Token::NAME))
+		{
+			return parse_var();
+		}
+		if (!is_token(Token::KEYWORD))
+		{
+			fatal_error_here("Expected declaration, got %s", token_info());
+		}
+		const InternId keyword{ token().name_id };
+		next_token();
+		switch (keyword)
+		{
+		case const_keyword_id:
+		{
+			const InternId name{ expect_name() };
+			const TypespecId type{ match_token(Token::COLON) ? parse_typespec() : NULL_AST_ID };
+			expect_token(Token::ASSIGN);
+			const ExprId expr{ parse_expr() };
+			expect_token(Token::SEMICOLON);
+			return ast->add_decl(DECL_CONST, decl_offset, name, type, expr);
+		}
+		case typedef_keyword_id:
+		{
+			const InternId name{ expect_name() };
+			expect_token(Token::ASSIGN);
+			const TypespecId type{ parse_typespec() };
+			expect_token(Token::SEMICOLON);
+			return ast->add_decl(DECL_TYPEDEF, decl_offset, name, type);
+		}
+		case struct_keyword_id: return parse_aggregate(DECL_STRUCT);
+		case union_keyword_id: return parse_aggregate(DECL_UNION);
+		case enum_keyword_id: return parse_enum();
+		case func_keyword_id: return parse_func();
+		case import_keyword_id:
+		{
+			// import a.b.c;
+			const size_t names{ scratch.size() };
+			do
+			{
+				const InternId name{ expect_name() };
+				scratch.push_back(name);
+			} while (match_token(Token::DOT));
+			expect_token(Token::SEMICOLON);
+			const uint32_t count{ static_cast<uint32_t>(scratch.size() - names) };
+			return ast->add_decl(DECL_IMPORT, decl_offset, end_list(names), count);
+		}
+		default:
+			fatal_error_here("Unexpected keyword %s at declaration", intern_str(keyword));
+			return NULL_AST_ID;
+		}
+	}
+
+	ExprId parse_expr_str(Parser *parser, const char *text, Ast *ast)
+	{
+		parser->init("<expr>", text, ast);
+		const ExprId expr{ parser->parse_expr() };
+		parser->expect_token(Token::END_OF_FILE);
+		return expr;
+	}
+
+	void parse_file(Parser *parser, const char *name, const char *text, Ast *ast)
+	{
+		parser->init(name, text, ast);
+		while (!parser->is_token(Token::END_OF_FILE))
+		{
+			if (parser->match_token(Token::SEMICOLON))
+			{
+				continue;
+			}
+			ast->file_decls.push_back(parser->parse_decl());
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+#include "Ast.hpp"
+#include "Lex.hpp"
+
+namespace ReVision
+{
+	// Binding powers of the infix operators, straight from the Token::Kind ranges.
+	// 0 means the token doesn't continue an expression.
+	#define TERNARY_BINDING_POWER 1
+	#define OR_OR_BINDING_POWER 2
+	#define AND_AND_BINDING_POWER 3
+	#define CMP_BINDING_POWER 4
+	#define ADD_BINDING_POWER 5
+	#define MUL_BINDING_POWER 6
+	#define UNARY_BINDING_POWER 7
+
+	struct BindingPowerTable
+	{
+		uint8_t infix[Token::NUM_TOKEN_KINDS];
+	};
+
+	constexpr BindingPowerTable make_binding_power_table()
+	{
+		BindingPowerTable table{};
+		for (int kind{ Token::FIRST_MUL }; kind <= Token::LAST_MUL; ++kind) { table.infix[kind] = MUL_BINDING_POWER; }
+		for (int kind{ Token::FIRST_ADD }; kind <= Token::LAST_ADD; ++kind) { table.infix[kind] = ADD_BINDING_POWER; }
+		for (int kind{ Token::FIRST_CMP }; kind <= Token::LAST_CMP; ++kind) { table.infix[kind] = CMP_BINDING_POWER; }
+		table.infix[Token::AND_AND] = AND_AND_BINDING_POWER;
+		table.infix[Token::OR_OR] = OR_OR_BINDING_POWER;
+		table.infix[Token::QUESTION] = TERNARY_BINDING_POWER;
+		return table;
+	}
+
+	inline constexpr BindingPowerTable binding_power_table{ make_binding_power_table() };
+
+	inline bool is_assign_op(Token::Kind kind) { return kind >= Token::FIRST_ASSIGN && kind <= Token::LAST_ASSIGN; }
+	inline bool is_unary_op(Token::Kind kind)
+	{
+		return kind == Token::ADD || kind == Token::SUB || kind == Token::MUL || kind == Token::AND || kind == Token::NEG || kind == Token::NOT;
+	}
+
+	// An operator or bracket still waiting for its right hand side while an expression is parsed.
+	struct ExprFrame
+	{
+		enum Kind : uint8_t
+		{
+			BINARY, // op, lhs
+			UNARY, // op
+			PAREN,
+			CALL, // lhs: callee, extra: start of the args in scratch
+			INDEX, // lhs: indexed expr
+			COMPOUND, // lhs: typespec, extra: start of the items in scratch
+			SIZEOF, // op: ExprKind
+			TERNARY_THEN, // lhs: cond
+			TERNARY_ELSE, // lhs: cond, extra: then expr
+		} kind;
+		uint8_t op;
+		uint8_t min_binding_power;
+		uint32_t offset;
+		uint32_t lhs;
+		uint32_t extra;
+	};
+
+	// Fixed window of upcoming tokens pulled from a Lexer on demand. The parser
+	// only ever needs a couple of tokens of lookahead (NAME ':' starts a
+	// declaration, NAME alone an expression), so the ring never allocates.
+	#define TOKEN_RING_SIZE 4
+	struct TokenRing
+	{
+		Token tokens[TOKEN_RING_SIZE];
+		uint32_t head;
+		uint32_t count;
+
+		void init(const Token &first);
+		// The token n ahead of the current one, lexing up to it if needed.
+		const Token &peek(Lexer *lexer, uint32_t n)
+		{
+			assert(n < TOKEN_RING_SIZE);
+			while (count <= n)
+			{
+				lexer->next_token();
+				tokens[(head + count++) % TOKEN_RING_SIZE] = lexer->token;
+			}
+			return tokens[(head + n) % TOKEN_RING_SIZE];
+		}
+		void pop(Lexer *lexer)
+		{
+			peek(lexer, 1);
+			head = (head + 1) % TOKEN_RING_SIZE;
+			--count;
+		}
+	};
+
+	// Parses a token stream straight into an Ast. Syntax errors are fatal, like expect_token.
+	// Declarations and statements are recursive descent, expressions use parse_expr.
+	// Throughput target: PARSER_TARGET_LINES_PER_SECOND on one core in a release build,
+	// measured by bench_parser on generated code.
+	#define PARSER_TARGET_LINES_PER_SECOND 1e6
+	struct Parser
+	{
+		Lexer lexer;
+		TokenRing ring;
+		Ast *ast;
+		// Explicit operator stack, so nesting depth costs heap instead of native stack.
+		std::vector<ExprFrame> frames;
+		// Children of lists still being parsed, copied into ast->lists once complete.
+		std::vector<uint32_t> scratch;
+
+		// Clears ast and starts lexing text into it.
+		void init(const char *name, const char *text, Ast *ast);
+
+		const Token &token() const { return ring.tokens[ring.head]; }
+		const Token &peek_token(uint32_t n) { return ring.peek(&lexer, n); }
+		Token::Kind kind() const { return token().kind; }
+		uint32_t offset() const { return token().pos.offset; }
+		void next_token() { ring.pop(&lexer); }
+		const char *token_info() const;
+		bool is_token(Token::Kind kind) const { return token().kind == kind; }
+		bool is_keyword(const char *name) const { return token().kind == Token::KEYWORD && token().name == name; }
+		bool match_token(Token::Kind kind);
+		bool match_keyword(const char *name);
+		bool expect_token(Token::Kind kind);
+		InternId expect_name();
+
+		ExprId parse_expr();
+		ExprId parse_paren_expr();
+		TypespecId parse_typespec();
+		StmtId parse_stmt();
+		StmtId parse_block();
+		StmtId parse_simple_stmt();
+		StmtId parse_if();
+		StmtId parse_switch();
+		DeclId parse_decl();
+		DeclId parse_aggregate(DeclKind kind);
+		DeclId parse_enum();
+		DeclId parse_func();
+		DeclId parse_var();
+		ListId end_list(size_t scratch_start);
+		bool is_decl_start();
+	};
+
+	// Parses a single expression, for tests and benchmarks.
+	ExprId parse_expr_str(Parser *parser, const char *text, Ast *ast);
+	// Parses a whole file into ast->file_decls.
+	void parse_file(Parser *parser, const char *name, const char *text, Ast *ast);
+}
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "Simd.hpp"
+
+#ifdef REVISION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+// The SIMD kernels read whole aligned blocks, past the '\0' sentinel up to the end of
+// its block. That never faults, but AddressSanitizer flags it, so they opt out.
+#if defined(__GNUC__) || defined(__clang__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#elif defined(_MSC_VER)
+#define NO_SANITIZE_ADDRESS __declspec(no_sanitize_address)
+#else
+#define NO_SANITIZE_ADDRESS
+#endif
+
+namespace ReVision
+{
+	uint32_t count_trailing_zeros(uint32_t x)
+	{
+		assert(x != 0);
+	#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, x);
+		return index;
+	#else
+		return static_cast<uint32_t>(__builtin_ctz(x));
+	#endif
+	}
+	uint32_t count_leading_zeros(uint32_t x)
+	{
+		assert(x != 0);
+	#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, x);
+		return 31 - index;
+	#else
+		return static_cast<uint32_t>(__builtin_clz(x));
+	#endif
+	}
+	uint32_t popcount(uint32_t x)
+	{
+	#ifdef _MSC_VER
+		x = x - ((x >> 1) & 0x55555555);
+		x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+		return (((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+	#else
+		return static_cast<uint32_t>(__builtin_popcount(x));
+	#endif
+	}
+
+	static const char *scalar_skip_space(const char *p)
+	{
+		while (is_space_char(*p)) { ++p; }
+		return p;
+	}
+	static const char *scalar_skip_line(const char *p)
+	{
+		while (*p && *p != '\n') { ++p; }
+		return p;
+	}
+	static const char *scalar_skip_to_comment_delim(const char *p)
+	{
+		while (*p && *p != '/' && *p != '*') { ++p; }
+		return p;
+	}
+
+	static const char *scalar_skip_ident(const char *p)
+	{
+		while (is_ident_char(*p)) { ++p; }
+		return p;
+	}
+	static const char *scalar_skip_digits(const char *p)
+	{
+		while (is_digit_char(*p)) { ++p; }
+		return p;
+	}
+	static const char *scalar_find_newlines(const char *text, std::vector<uint32_t> *line_starts)
+	{
+		const char *p{ text };
+		for (; *p; ++p)
+		{
+			if (*p == '\n') { line_starts->push_back(static_cast<uint32_t>(p + 1 - text)); }
+		}
+		return p;
+	}
+
+	const ScanKernels scalar_kernels{ "scalar", scalar_skip_space, scalar_skip_line, scalar_skip_to_comment_delim, scalar_skip_ident, scalar_skip_digits,
+		scalar_find_newlines };
+
+	#ifdef REVISION_X86
+	// newlines is the mask of '\n' bytes in the block, end the mask of '\0' bytes.
+	// Returns true once the block held the terminator.
+	static inline bool push_newlines(const char *text, const char *block, uint32_t newlines, uint32_t end, std::vector<uint32_t> *line_starts)
+	{
+		if (end)
+		{
+			newlines &= (1u << count_trailing_zeros(end)) - 1;
+		}
+		const uint32_t offset{ static_cast<uint32_t>(block - text) + 1 };
+		for (; newlines; newlines &= newlines - 1)
+		{
+			line_starts->push_back(offset + count_trailing_zeros(newlines));
+		}
+		return end != 0;
+	}
+
+	// Loads are aligned, the bytes in front of p are masked off with valid.
+	// Unsigned lo <= v <= hi, done as a single range check on v - lo.
+	static inline __m128i sse2_in_range(__m128i v, char lo, char hi)
+	{
+		const __m128i x{ _mm_sub_epi8(v, _mm_set1_epi8(lo)) };
+		return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(static_cast<char>(hi - lo))), x);
+	}
+	static inline __m128i sse2_is_space(__m128i v)
+	{
+		return _mm_or_si128(sse2_in_range(v, '\t', '\r'), _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+	}
+	NO_SANITIZE_ADDRESS static const char *sse2_skip_space(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 16)) };
+		uint32_t valid{ (0xFFFFu << (p - block)) & 0xFFFFu };
+		for (;; block += 16, valid = 0xFFFFu)
+		{
+			const __m128i v{ _mm_load_si128(reinterpret_cast<const __m128i *>(block)) };
+			const uint32_t stop{ ~static_cast<uint32_t>(_mm_movemask_epi8(sse2_is_space(v))) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+	NO_SANITIZE_ADDRESS static const char *sse2_skip_line(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 16)) };
+		uint32_t valid{ (0xFFFFu << (p - block)) & 0xFFFFu };
+		for (;; block += 16, valid = 0xFFFFu)
+		{
+			const __m128i v{ _mm_load_si128(reinterpret_cast<const __m128i *>(block)) };
+			const __m128i hits{ _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_setzero_si128())) };
+			const uint32_t stop{ static_cast<uint32_t>(_mm_movemask_epi8(hits)) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+	NO_SANITIZE_ADDRESS static const char *sse2_skip_to_comment_delim(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 16)) };
+		uint32_t valid{ (0xFFFFu << (p - block)) & 0xFFFFu };
+		for (;; block += 16, valid = 0xFFFFu)
+		{
+			const __m128i v{ _mm_load_si128(reinterpret_cast<const __m128i *>(block)) };
+			const __m128i hits{ _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('/')), _mm_cmpeq_epi8(v, _mm_set1_epi8('*'))),
+				_mm_cmpeq_epi8(v, _mm_setzero_si128())) };
+			const uint32_t stop{ static_cast<uint32_t>(_mm_movemask_epi8(hits)) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+
+	static inline __m128i sse2_is_ident(__m128i v)
+	{
+		// Setting bit 5 folds 'A'-'Z' onto 'a'-'z' and leaves the digits alone
+		const __m128i lower{ _mm_or_si128(v, _mm_set1_epi8(0x20)) };
+		return _mm_or_si128(_mm_or_si128(sse2_in_range(lower, 'a', 'z'), sse2_in_range(v, '0', '9')), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+	}
+	NO_SANITIZE_ADDRESS static const char *sse2_skip_ident(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 16)) };
+		uint32_t valid{ (0xFFFFu << (p - block)) & 0xFFFFu };
+		for (;; block += 16, valid = 0xFFFFu)
+		{
+			const __m128i v{ _mm_load_si128(reinterpret_cast<const __m128i *>(block)) };
+			const uint32_t stop{ ~static_cast<uint32_t>(_mm_movemask_epi8(sse2_is_ident(v))) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+	NO_SANITIZE_ADDRESS static const char *sse2_skip_digits(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 16)) };
+		uint32_t valid{ (0xFFFFu << (p - block)) & 0xFFFFu };
+		for (;; block += 16, valid = 0xFFFFu)
+		{
+			const __m128i v{ _mm_load_si128(reinterpret_cast<const __m128i *>(block)) };
+			const uint32_t stop{ ~static_cast<uint32_t>(_mm_movemask_epi8(sse2_in_range(v, '0', '9'))) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+
+	NO_SANITIZE_ADDRESS static const char *sse2_find_newlines(const char *text, std::vector<uint32_t> *line_starts)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(text, 16)) };
+		uint32_t valid{ (0xFFFFu << (text - block)) & 0xFFFFu };
+		for (;; block += 16, valid = 0xFFFFu)
+		{
+			const __m128i v{ _mm_load_si128(reinterpret_cast<const __m128i *>(block)) };
+			const uint32_t newlines{ static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))) & valid };
+			const uint32_t end{ static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()))) & valid };
+			if (push_newlines(text, block, newlines, end, line_starts))
+			{
+				return block + count_trailing_zeros(end);
+			}
+		}
+	}
+
+	const ScanKernels sse2_kernels{ "sse2", sse2_skip_space, sse2_skip_line, sse2_skip_to_comment_delim, sse2_skip_ident, sse2_skip_digits,
+		sse2_find_newlines };
+
+	TARGET_AVX2 static inline __m256i avx2_in_range(__m256i v, char lo, char hi)
+	{
+		const __m256i x{ _mm256_sub_epi8(v, _mm256_set1_epi8(lo)) };
+		return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(static_cast<char>(hi - lo))), x);
+	}
+	TARGET_AVX2 static inline __m256i avx2_is_space(__m256i v)
+	{
+		return _mm256_or_si256(avx2_in_range(v, '\t', '\r'), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+	}
+	TARGET_AVX2 NO_SANITIZE_ADDRESS static const char *avx2_skip_space(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 32)) };
+		uint32_t valid{ 0xFFFFFFFFu << (p - block) };
+		for (;; block += 32, valid = 0xFFFFFFFFu)
+		{
+			const __m256i v{ _mm256_load_si256(reinterpret_cast<const __m256i *>(block)) };
+			const uint32_t stop{ ~static_cast<uint32_t>(_mm256_movemask_epi8(avx2_is_space(v))) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+	TARGET_AVX2 NO_SANITIZE_ADDRESS static const char *avx2_skip_line(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 32)) };
+		uint32_t valid{ 0xFFFFFFFFu << (p - block) };
+		for (;; block += 32, valid = 0xFFFFFFFFu)
+		{
+			const __m256i v{ _mm256_load_si256(reinterpret_cast<const __m256i *>(block)) };
+			const __m256i hits{ _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_setzero_si256())) };
+			const uint32_t stop{ static_cast<uint32_t>(_mm256_movemask_epi8(hits)) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+	TARGET_AVX2 NO_SANITIZE_ADDRESS static const char *avx2_skip_to_comment_delim(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 32)) };
+		uint32_t valid{ 0xFFFFFFFFu << (p - block) };
+		for (;; block += 32, valid = 0xFFFFFFFFu)
+		{
+			const __m256i v{ _mm256_load_si256(reinterpret_cast<const __m256i *>(block)) };
+			const __m256i hits{ _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*'))),
+				_mm256_cmpeq_epi8(v, _mm256_setzero_si256())) };
+			const uint32_t stop{ static_cast<uint32_t>(_mm256_movemask_epi8(hits)) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+
+	TARGET_AVX2 static inline __m256i avx2_is_ident(__m256i v)
+	{
+		const __m256i lower{ _mm256_or_si256(v, _mm256_set1_epi8(0x20)) };
+		return _mm256_or_si256(_mm256_or_si256(avx2_in_range(lower, 'a', 'z'), avx2_in_range(v, '0', '9')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+	}
+	TARGET_AVX2 NO_SANITIZE_ADDRESS static const char *avx2_skip_ident(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 32)) };
+		uint32_t valid{ 0xFFFFFFFFu << (p - block) };
+		for (;; block += 32, valid = 0xFFFFFFFFu)
+		{
+			const __m256i v{ _mm256_load_si256(reinterpret_cast<const __m256i *>(block)) };
+			const uint32_t stop{ ~static_cast<uint32_t>(_mm256_movemask_epi8(avx2_is_ident(v))) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+	TARGET_AVX2 NO_SANITIZE_ADDRESS static const char *avx2_skip_digits(const char *p)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(p, 32)) };
+		uint32_t valid{ 0xFFFFFFFFu << (p - block) };
+		for (;; block += 32, valid = 0xFFFFFFFFu)
+		{
+			const __m256i v{ _mm256_load_si256(reinterpret_cast<const __m256i *>(block)) };
+			const uint32_t stop{ ~static_cast<uint32_t>(_mm256_movemask_epi8(avx2_in_range(v, '0', '9'))) & valid };
+			if (stop)
+			{
+				return block + count_trailing_zeros(stop);
+			}
+		}
+	}
+
+	TARGET_AVX2 NO_SANITIZE_ADDRESS static const char *avx2_find_newlines(const char *text, std::vector<uint32_t> *line_starts)
+	{
+		const char *block{ static_cast<const char *>(ALIGN_DOWN_PTR(text, 32)) };
+		uint32_t valid{ 0xFFFFFFFFu << (text - block) };
+		for (;; block += 32, valid = 0xFFFFFFFFu)
+		{
+			const __m256i v{ _mm256_load_si256(reinterpret_cast<const __m256i *>(block)) };
+			const uint32_t newlines{ static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')))) & valid };
+			const uint32_t end{ static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()))) & valid };
+			if (push_newlines(text, block, newlines, end, line_starts))
+			{
+				return block + count_trailing_zeros(end);
+			}
+		}
+	}
+
+	const ScanKernels avx2_kernels{ "avx2", avx2_skip_space, avx2_skip_line, avx2_skip_to_comment_delim, avx2_skip_ident, avx2_skip_digits,
+		avx2_find_newlines };
+	#endif
+
+	bool cpu_has_avx2()
+	{
+	#if !defined(REVISION_X86)
+		return false;
+	#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) { return false; }
+		__cpuid(info, 1);
+		// OSXSAVE and AVX, then check that the OS saves the ymm registers
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) { return false; }
+		if ((_xgetbv(0) & 6) != 6) { return false; }
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+	#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	#endif
+	}
+
+	static const ScanKernels &select_scan_kernels()
+	{
+	#ifdef REVISION_X86
+		if (cpu_has_avx2())
+		{
+			return avx2_kernels;
+		}
+		return sse2_kernels;
+	#else
+		return scalar_kernels;
+	#endif
+	}
+
+	const ScanKernels &scan_kernels{ select_scan_kernels() };
+
+	std::vector<const ScanKernels *> supported_scan_kernels()
+	{
+		std::vector<const ScanKernels *> kernels{ &scalar_kernels };
+	#ifdef REVISION_X86
+		kernels.push_back(&sse2_kernels);
+		if (cpu_has_avx2())
+		{
+			kernels.push_back(&avx2_kernels);
+		}
+	#endif
+		return kernels;
+	}
+}
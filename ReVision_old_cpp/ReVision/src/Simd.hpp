@@ -0,0 +1,86 @@
+#pragma once
+#include "Common.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define REVISION_X86 1
+#endif
+
+namespace ReVision
+{
+	enum CharClass : uint8_t
+	{
+		CHAR_SPACE = 1 << 0, // ' ', '\t', '\n', '\v', '\f', '\r'
+		CHAR_DIGIT = 1 << 1, // 0-9
+		CHAR_ALPHA = 1 << 2, // a-z, A-Z and '_'
+		CHAR_HEX = 1 << 3, // 0-9, a-f, A-F
+		CHAR_IDENT = CHAR_ALPHA | CHAR_DIGIT,
+	};
+
+	struct CharClassTable
+	{
+		uint8_t classes[256];
+		// Digit value for 0-9, a-f and A-F, 0 for everything else
+		uint8_t digits[256];
+	};
+
+	constexpr CharClassTable make_char_class_table()
+	{
+		CharClassTable table{};
+		for (int c{ 0 }; c < 256; ++c)
+		{
+			uint8_t classes{ 0 };
+			if (c == ' ' || (c >= '\t' && c <= '\r')) { classes |= CHAR_SPACE; }
+			if (c >= '0' && c <= '9') { classes |= CHAR_DIGIT | CHAR_HEX; table.digits[c] = static_cast<uint8_t>(c - '0'); }
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') { classes |= CHAR_ALPHA; }
+			if (c >= 'a' && c <= 'f') { classes |= CHAR_HEX; table.digits[c] = static_cast<uint8_t>(c - 'a' + 10); }
+			if (c >= 'A' && c <= 'F') { classes |= CHAR_HEX; table.digits[c] = static_cast<uint8_t>(c - 'A' + 10); }
+			table.classes[c] = classes;
+		}
+		return table;
+	}
+
+	// Locale independent replacements for the <cctype> functions.
+	inline constexpr CharClassTable char_class_table{ make_char_class_table() };
+
+	inline bool char_is(char c, uint8_t classes) { return (char_class_table.classes[static_cast<uint8_t>(c)] & classes) != 0; }
+	inline bool is_space_char(char c) { return char_is(c, CHAR_SPACE); }
+	inline bool is_digit_char(char c) { return char_is(c, CHAR_DIGIT); }
+	inline bool is_ident_char(char c) { return char_is(c, CHAR_IDENT); }
+	inline char to_lower_char(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c; }
+
+	uint32_t count_trailing_zeros(uint32_t x);
+	uint32_t count_leading_zeros(uint32_t x);
+	uint32_t popcount(uint32_t x);
+
+	// Scanning kernels used by next_token. They all stop at the '\0' sentinel and
+	// never read past the aligned 16 or 32 byte block that contains it, so a mapped
+	// source never faults, even right at the end of a page.
+	struct ScanKernels
+	{
+		const char *name;
+		// Skips ' ', '\t', '\n', '\v', '\f' and '\r'.
+		const char *(*skip_space)(const char *p);
+		// Returns the first '\n' or '\0'.
+		const char *(*skip_line)(const char *p);
+		// Returns the first '/', '*' or '\0', the candidates for "/*" and "*/".
+		const char *(*skip_to_comment_delim)(const char *p);
+		// Returns the first byte that isn't a letter, digit or '_'.
+		const char *(*skip_ident)(const char *p);
+		// Returns the first byte that isn't a decimal digit.
+		const char *(*skip_digits)(const char *p);
+		// Appends the offset of the byte after every '\n' before the '\0', returns the '\0'.
+		const char *(*find_newlines)(const char *text, std::vector<uint32_t> *line_starts);
+	};
+
+	extern const ScanKernels scalar_kernels;
+	#ifdef REVISION_X86
+	extern const ScanKernels sse2_kernels;
+	extern const ScanKernels avx2_kernels;
+	#endif
+	bool cpu_has_avx2();
+
+	// The best kernels this CPU supports, picked once at startup.
+	extern const ScanKernels &scan_kernels;
+	// Every kernel set this CPU can run, scalar first.
+	std::vector<const ScanKernels *> supported_scan_kernels();
+}
@@ -0,0 +1,147 @@
+#include "Source.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ReVision
+{
+	size_t page_size()
+	{
+	#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+	#else
+		return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	#endif
+	}
+
+	static bool source_copy(SourceMap *map, const char *path)
+	{
+		map->text = read_file(path, &map->len);
+		map->backing = SourceMap::Backing::COPY;
+		return map->text != nullptr;
+	}
+
+	bool source_map(SourceMap *map, const char *path)
+	{
+		*map = SourceMap{ "", 0, SourceMap::Backing::NONE, nullptr, 0 };
+		const size_t page{ page_size() };
+	#ifdef _WIN32
+		HANDLE file{ CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			return false;
+		}
+		const size_t len{ static_cast<size_t>(size.QuadPart) };
+		if (len == 0)
+		{
+			CloseHandle(file);
+			return true;
+		}
+		if (len % page == 0)
+		{
+			// Windows can't place a zero page behind a view, so copy instead.
+			CloseHandle(file);
+			return source_copy(map, path);
+		}
+		HANDLE mapping{ CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+		CloseHandle(file);
+		if (!mapping)
+		{
+			return source_copy(map, path);
+		}
+		void *base{ MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) };
+		CloseHandle(mapping);
+		if (!base)
+		{
+			return source_copy(map, path);
+		}
+		map->map_base = base;
+		map->map_size = len;
+	#else
+		const int fd{ open(path, O_RDONLY) };
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+		{
+			close(fd);
+			return false;
+		}
+		const size_t len{ static_cast<size_t>(st.st_size) };
+		if (len == 0)
+		{
+			close(fd);
+			return true;
+		}
+		void *base;
+		size_t map_size;
+		if (len % page != 0)
+		{
+			map_size = ALIGN_UP(len, page);
+			base = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		else
+		{
+			// Reserve one zero page more than the file and map the file over the front of it.
+			map_size = len + page;
+			base = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (base != MAP_FAILED && mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+			{
+				munmap(base, map_size);
+				base = MAP_FAILED;
+			}
+		}
+		close(fd);
+		if (base == MAP_FAILED)
+		{
+			return source_copy(map, path);
+		}
+		madvise(base, map_size, MADV_SEQUENTIAL);
+		map->map_base = base;
+		map->map_size = map_size;
+	#endif
+		map->text = static_cast<const char *>(map->map_base);
+		map->len = len;
+		map->backing = SourceMap::Backing::MAPPED;
+		assert(map->text[len] == 0);
+		return true;
+	}
+
+	void source_unmap(SourceMap *map)
+	{
+		switch (map->backing)
+		{
+		case SourceMap::Backing::MAPPED:
+		#ifdef _WIN32
+			UnmapViewOfFile(map->map_base);
+		#else
+			munmap(map->map_base, map->map_size);
+		#endif
+			break;
+		case SourceMap::Backing::COPY:
+			std::free(const_cast<char *>(map->text));
+			break;
+		case SourceMap::Backing::NONE:
+			break;
+		}
+		*map = SourceMap{ "", 0, SourceMap::Backing::NONE, nullptr, 0 };
+	}
+}
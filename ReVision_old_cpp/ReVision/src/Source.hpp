@@ -0,0 +1,31 @@
+#pragma once
+#include "Common.hpp"
+
+namespace ReVision
+{
+	// A read-only view of a source file that is always followed by a '\0'
+	// sentinel, which is what next_token relies on to stop at END_OF_FILE.
+	struct SourceMap
+	{
+		enum class Backing
+		{
+			NONE, // empty file, text points at a static ""
+			MAPPED, // text points straight into the file mapping
+			COPY, // text is a heap copy made by read_file
+		};
+
+		const char *text;
+		size_t len;
+		Backing backing;
+		void *map_base;
+		size_t map_size;
+	};
+
+	size_t page_size();
+	// Maps the file read-only. If the file doesn't end on a page boundary, the rest
+	// of the last page is zero-filled by the OS and serves as the sentinel. Otherwise
+	// one anonymous zero page is mapped right behind the file, and only when that
+	// fails the file is copied to the heap.
+	bool source_map(SourceMap *map, const char *path);
+	void source_unmap(SourceMap *map);
+}
@@ -0,0 +1,158 @@
+#include "Stats.hpp"
+#include "Lex.hpp"
+
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace ReVision
+{
+	PhaseTime phase_times[NUM_STAT_PHASES];
+	const char *const phase_names[NUM_STAT_PHASES]{ "load", "lex", "merge interns", "remap", "cache write" };
+
+	static const char *const stat_counter_names[NUM_STAT_COUNTERS]{
+		"bytes lexed", "intern lookups", "intern inserts", "intern probes", "arena blocks", "arena reused blocks", "arena bytes",
+		"token cache hits", "token cache misses",
+	};
+
+	// Blocks are never freed, so a thread's counts survive the thread itself.
+	static std::mutex thread_stats_mutex;
+	static std::vector<std::unique_ptr<StatCounters>> all_thread_stats;
+
+	StatCounters *register_thread_stats()
+	{
+		std::lock_guard<std::mutex> lock(thread_stats_mutex);
+		all_thread_stats.push_back(std::make_unique<StatCounters>());
+		return all_thread_stats.back().get();
+	}
+
+	StatCounters total_stats()
+	{
+		StatCounters total{};
+		std::lock_guard<std::mutex> lock(thread_stats_mutex);
+		for (const std::unique_ptr<StatCounters> &stats : all_thread_stats)
+		{
+			for (size_t i{ 0 }; i < NUM_STAT_COUNTERS; ++i) { total.counters[i] += stats->counters[i]; }
+			for (size_t i{ 0 }; i < STATS_MAX_TOKEN_KINDS; ++i) { total.token_kinds[i] += stats->token_kinds[i]; }
+			for (size_t i{ 0 }; i < STATS_PROBE_BUCKETS; ++i) { total.intern_probe_histogram[i] += stats->intern_probe_histogram[i]; }
+			total.max_intern_probe = std::max(total.max_intern_probe, stats->max_intern_probe);
+		}
+		return total;
+	}
+
+	void reset_stats()
+	{
+		{
+			std::lock_guard<std::mutex> lock(thread_stats_mutex);
+			for (const std::unique_ptr<StatCounters> &stats : all_thread_stats)
+			{
+				*stats = StatCounters{};
+			}
+		}
+		for (PhaseTime &phase : phase_times)
+		{
+			phase = PhaseTime{};
+		}
+	}
+
+	double cpu_seconds()
+	{
+	#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		{
+			return 0.0;
+		}
+		const uint64_t kernel_ticks{ (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime };
+		const uint64_t user_ticks{ (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime };
+		// FILETIME counts 100ns ticks
+		return static_cast<double>(kernel_ticks + user_ticks) * 1e-7;
+	#else
+		timespec ts;
+		if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+		{
+			return 0.0;
+		}
+		return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+	#endif
+	}
+
+#if REVISION_STATS
+	static double wall_seconds()
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void PhaseTimer::start(StatPhase phase)
+	{
+		this->phase = phase;
+		running = true;
+		wall_start = wall_seconds();
+		cpu_start = cpu_seconds();
+	}
+	void PhaseTimer::stop()
+	{
+		if (!running)
+		{
+			return;
+		}
+		running = false;
+		PhaseTime &time{ phase_times[phase] };
+		time.wall_seconds += wall_seconds() - wall_start;
+		time.cpu_seconds += cpu_seconds() - cpu_start;
+		++time.count;
+	}
+#endif
+
+	void print_stats(FILE *file)
+	{
+	#if REVISION_STATS
+		const StatCounters stats{ total_stats() };
+		std::fprintf(file, "phase              wall ms     cpu ms\n");
+		for (size_t i{ 0 }; i < NUM_STAT_PHASES; ++i)
+		{
+			if (phase_times[i].count)
+			{
+				std::fprintf(file, "  %-14s %10.3f %10.3f\n", phase_names[i], phase_times[i].wall_seconds * 1000.0, phase_times[i].cpu_seconds * 1000.0);
+			}
+		}
+		for (size_t i{ 0 }; i < NUM_STAT_COUNTERS; ++i)
+		{
+			std::fprintf(file, "%-20s %12" PRIu64 "\n", stat_counter_names[i], stats.counters[i]);
+		}
+
+		// A concurrent intern can search both the global table and a shard, so count the searches themselves
+		uint64_t num_finds{ 0 };
+		for (uint64_t count : stats.intern_probe_histogram) { num_finds += count; }
+		std::fprintf(file, "intern probe length: %.3f average, %" PRIu64 " max\n ",
+			static_cast<double>(stats.counters[STAT_INTERN_PROBES]) / static_cast<double>(std::max<uint64_t>(num_finds, 1)), stats.max_intern_probe);
+		for (size_t i{ 0 }; i < STATS_PROBE_BUCKETS; ++i)
+		{
+			std::fprintf(file, " %zu%s: %" PRIu64, i, i + 1 == STATS_PROBE_BUCKETS ? "+" : "", stats.intern_probe_histogram[i]);
+		}
+
+		uint64_t num_tokens{ 0 };
+		std::vector<size_t> kinds;
+		for (size_t i{ 0 }; i < Token::NUM_TOKEN_KINDS; ++i)
+		{
+			num_tokens += stats.token_kinds[i];
+			if (stats.token_kinds[i]) { kinds.push_back(i); }
+		}
+		std::stable_sort(kinds.begin(), kinds.end(), [&](size_t a, size_t b) { return stats.token_kinds[a] > stats.token_kinds[b]; });
+		std::fprintf(file, "\ntokens %20" PRIu64 "\n", num_tokens);
+		for (size_t kind : kinds)
+		{
+			std::fprintf(file, "  %-12s %12" PRIu64 " %6.2f%%\n", token_kind_name(token_cast(kind)), stats.token_kinds[kind],
+				100.0 * static_cast<double>(stats.token_kinds[kind]) / static_cast<double>(num_tokens));
+		}
+	#else
+		std::fprintf(file, "statistics were compiled out, rebuild with REVISION_STATS=1\n");
+	#endif
+	}
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+#include "Common.hpp"
+
+// Set REVISION_STATS to 0 to compile every counter and phase timer out.
+#ifndef REVISION_STATS
+#define REVISION_STATS 1
+#endif
+
+namespace ReVision
+{
+	enum StatCounter
+	{
+		STAT_BYTES_LEXED,
+		STAT_INTERN_LOOKUPS,
+		STAT_INTERN_INSERTS,
+		// Total slots stepped over past the home slot, see intern_probe_histogram
+		STAT_INTERN_PROBES,
+		STAT_ARENA_BLOCKS,
+		STAT_ARENA_REUSED_BLOCKS,
+		STAT_ARENA_BYTES,
+		STAT_TOKEN_CACHE_HITS,
+		STAT_TOKEN_CACHE_MISSES,
+		NUM_STAT_COUNTERS,
+	};
+
+	enum StatPhase
+	{
+		PHASE_LOAD,
+		PHASE_LEX,
+		PHASE_MERGE_INTERNS,
+		PHASE_REMAP,
+		PHASE_CACHE_WRITE,
+		NUM_STAT_PHASES,
+	};
+
+	// Big enough for Token::NUM_TOKEN_KINDS, Lex.cpp checks that it is.
+	#define STATS_MAX_TOKEN_KINDS 64
+	// Probe lengths 0 to 6 get their own bucket, the last one counts everything longer.
+	#define STATS_PROBE_BUCKETS 8
+
+	struct StatCounters
+	{
+		uint64_t counters[NUM_STAT_COUNTERS];
+		uint64_t token_kinds[STATS_MAX_TOKEN_KINDS];
+		uint64_t intern_probe_histogram[STATS_PROBE_BUCKETS];
+		uint64_t max_intern_probe;
+	};
+
+	struct PhaseTime
+	{
+		double wall_seconds;
+		// Process CPU time, so it exceeds wall time when a phase runs on several threads
+		double cpu_seconds;
+		uint64_t count;
+	};
+
+	// Every thread counts into its own block, registered the first time it counts
+	// anything, so the hot paths never share a cache line or take a lock.
+	StatCounters *register_thread_stats();
+	inline thread_local StatCounters *thread_stat_counters{ nullptr };
+
+	inline StatCounters &thread_stats()
+	{
+		if (!thread_stat_counters)
+		{
+			thread_stat_counters = register_thread_stats();
+		}
+		return *thread_stat_counters;
+	}
+	inline void stat_intern_probe(size_t len)
+	{
+		StatCounters &stats{ thread_stats() };
+		stats.counters[STAT_INTERN_PROBES] += len;
+		++stats.intern_probe_histogram[std::min<size_t>(len, STATS_PROBE_BUCKETS - 1)];
+		stats.max_intern_probe = std::max<uint64_t>(stats.max_intern_probe, len);
+	}
+
+	// Sums the blocks of every thread that ever counted. Only exact while no other
+	// thread is counting, e.g. after parallel_for returns.
+	StatCounters total_stats();
+	// Phases are timed by the driving thread, so these need no synchronization.
+	extern PhaseTime phase_times[NUM_STAT_PHASES];
+	extern const char *const phase_names[NUM_STAT_PHASES];
+	void reset_stats();
+	double cpu_seconds();
+	void print_stats(FILE *file);
+
+#if REVISION_STATS
+	#define STAT_ADD(counter, n) (ReVision::thread_stats().counters[(counter)] += static_cast<uint64_t>(n))
+	#define STAT_INC(counter) STAT_ADD((counter), 1)
+	#define STAT_TOKEN(kind) (++ReVision::thread_stats().token_kinds[(kind)])
+	#define STAT_INTERN_PROBE(len) ReVision::stat_intern_probe((len))
+
+	// Times consecutive phases: each next() closes the running phase and opens another one.
+	struct PhaseTimer
+	{
+		explicit PhaseTimer(StatPhase phase) { start(phase); }
+		~PhaseTimer() { stop(); }
+		void next(StatPhase phase) { stop(); start(phase); }
+		void stop();
+
+	private:
+		void start(StatPhase phase);
+
+		StatPhase phase;
+		bool running{ false };
+		double wall_start;
+		double cpu_start;
+	};
+#else
+	#define STAT_ADD(counter, n) ((void)0)
+	#define STAT_INC(counter) ((void)0)
+	#define STAT_TOKEN(kind) ((void)0)
+	#define STAT_INTERN_PROBE(len) ((void)0)
+
+	struct PhaseTimer
+	{
+		explicit PhaseTimer(StatPhase) {}
+		void next(StatPhase) {}
+		void stop() {}
+	};
+#endif
+}
\ No newline at end of file
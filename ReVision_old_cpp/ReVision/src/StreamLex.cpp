@@ -0,0 +1,237 @@
+#include "StreamLex.hpp"
+#include "Diag.hpp"
+#include "Stats.hpp"
+
+namespace ReVision
+{
+	size_t stream_read_file(void *file, char *dst, size_t max_len)
+	{
+		return std::fread(dst, 1, max_len, static_cast<FILE *>(file));
+	}
+
+	// The range the lexer asked to intern for the token being lexed, nullptr if none
+	static thread_local const char *pending_intern_start;
+	static thread_local const char *pending_intern_end;
+
+	static const char *defer_intern_range(const char *start, const char *end, InternId *id)
+	{
+		pending_intern_start = start;
+		pending_intern_end = end;
+		*id = INVALID_INTERN_ID;
+		return nullptr;
+	}
+
+	void StreamLexer::init(const char *name, StreamRead read, void *user, size_t chunk_size)
+	{
+		this->name = name ? name : "<stream>";
+		this->read = read;
+		this->user = user;
+		// Room for more than the lookahead, or a chunk could never complete a token
+		this->chunk_size = std::max<size_t>(chunk_size, 4 * RELEX_LOOKAHEAD);
+		buf.assign(2 * this->chunk_size + 1, '\0');
+		len = 0;
+		base_offset = 0;
+		counted_offset = 0;
+		comment_depth = 0;
+		in_line_comment = false;
+		at_eof = false;
+		lexer.intern_range = defer_intern_range;
+		init_interns();
+		lexer.lines.init(this->name, buf.data());
+		refill(buf.data());
+		lexer.stream = buf.data();
+		next_token();
+	}
+
+	void StreamLexer::refill(const char *keep_from)
+	{
+		const size_t consumed{ static_cast<size_t>(keep_from - buf.data()) };
+		const size_t keep{ len - consumed };
+
+		// Line and column of keep_from, which becomes buf[0]
+		int first_line{ lexer.lines.first_line };
+		int first_col{ lexer.lines.first_col };
+		const char *last_newline{ nullptr };
+		const char *p{ buf.data() };
+		while (const void *newline{ std::memchr(p, '\n', static_cast<size_t>(keep_from - p)) })
+		{
+			last_newline = static_cast<const char *>(newline);
+			++first_line;
+			p = last_newline + 1;
+		}
+		first_col = last_newline ? static_cast<int>(keep_from - last_newline) : first_col + static_cast<int>(consumed);
+
+		std::memmove(buf.data(), keep_from, keep);
+		base_offset += consumed;
+		len = keep;
+		if (buf.size() < keep + chunk_size + 1)
+		{
+			// Only a token longer than a chunk gets here
+			buf.resize(keep + chunk_size + 1);
+		}
+		const size_t num_read{ read(user, buf.data() + len, chunk_size) };
+		at_eof = (num_read == 0);
+		len += num_read;
+		buf[len] = '\0';
+
+		lexer.lines.init(name, buf.data());
+		lexer.lines.first_line = first_line;
+		lexer.lines.first_col = first_col;
+		lexer.token.pos.file = &lexer.lines;
+	}
+
+	void StreamLexer::skip_trivia()
+	{
+		const char *p{ lexer.stream };
+		for (;;)
+		{
+			const char *end{ buf.data() + len };
+			if (in_line_comment)
+			{
+				p = scan_kernels.skip_line(p);
+				if (!at_eof && p == end)
+				{
+					refill(p); p = buf.data();
+					continue;
+				}
+				in_line_comment = false;
+			}
+			else if (comment_depth > 0)
+			{
+				p = scan_kernels.skip_to_comment_delim(p);
+				// A delimiter can be split over two chunks, so keep its first half
+				if (!at_eof && p + 1 >= end)
+				{
+					refill(p); p = buf.data();
+					continue;
+				}
+				if (!*p)
+				{
+					// Unterminated at the end of the input, the lexer sees END_OF_FILE next
+					break;
+				}
+				if (p[0] == '/' && p[1] == '*')
+				{
+					++comment_depth; p += 2;
+				}
+				else if (p[0] == '*' && p[1] == '/')
+				{
+					--comment_depth; p += 2;
+				}
+				else
+				{
+					++p;
+				}
+			}
+			else
+			{
+				p = scan_kernels.skip_space(p);
+				if (!at_eof && p + 1 >= end)
+				{
+					refill(p); p = buf.data();
+					continue;
+				}
+				if (p[0] == '/' && p[1] == '/')
+				{
+					in_line_comment = true; p += 2;
+				}
+				else if (p[0] == '/' && p[1] == '*')
+				{
+					comment_depth = 1; p += 2;
+				}
+				else
+				{
+					break;
+				}
+			}
+		}
+		lexer.stream = p;
+	}
+
+	void StreamLexer::lex_uncounted()
+	{
+	#if REVISION_STATS
+		StatCounters &stats{ thread_stats() };
+		const uint64_t bytes_before{ stats.counters[STAT_BYTES_LEXED] };
+	#endif
+		lexer.next_token();
+	#if REVISION_STATS
+		stats.counters[STAT_BYTES_LEXED] = bytes_before;
+		--stats.token_kinds[lexer.token.kind];
+	#endif
+	}
+
+	void StreamLexer::next_token()
+	{
+		for (;;)
+		{
+			skip_trivia();
+			const char *start{ lexer.stream };
+			const DiagMark mark{ diag_mark() };
+			pending_intern_start = nullptr;
+			lex_uncounted();
+			if (lexer.token.start != start)
+			{
+				// The lexer skipped an invalid char, then went on to skip whatever trivia
+				// follows on its own, which could grow the buffer to a whole comment. Lex the
+				// char again cut off after it so only it gets reported and skipped.
+				diag_rollback(mark);
+				char *const next{ &buf[static_cast<size_t>(start - buf.data()) + 1] };
+				const char saved{ *next };
+				*next = '\0';
+				lexer.stream = start;
+				lex_uncounted();
+				*next = saved;
+				lexer.stream = next;
+				continue;
+			}
+			if (at_eof || static_cast<size_t>(buf.data() + len - lexer.stream) > RELEX_LOOKAHEAD)
+			{
+				if (pending_intern_start)
+				{
+					// Still valid, it points into buf or lexer.str_buf
+					lexer.token.name = intern_range(pending_intern_start, pending_intern_end, &lexer.token.name_id);
+				}
+				const uint64_t offset{ base_offset + static_cast<uint64_t>(lexer.stream - buf.data()) };
+				STAT_TOKEN(lexer.token.kind);
+				STAT_ADD(STAT_BYTES_LEXED, offset - counted_offset);
+				counted_offset = offset;
+				return;
+			}
+			// The token may go on in the next chunk, lex it again once that is in
+			diag_rollback(mark);
+			refill(start);
+			lexer.stream = buf.data();
+		}
+	}
+
+	bool stream_lex_file(const char *path, size_t chunk_size, StreamLexStats *stats,
+		void (*on_token)(void *user, const StreamLexer &lexer), void *user)
+	{
+		FILE *file{ std::fopen(path, "rb") };
+		if (!file)
+		{
+			return false;
+		}
+		StreamLexer lexer;
+		lexer.init(path, stream_read_file, file, chunk_size);
+		*stats = StreamLexStats{};
+		for (;;)
+		{
+			++stats->num_tokens;
+			if (on_token)
+			{
+				on_token(user, lexer);
+			}
+			if (lexer.lexer.token.kind == Token::END_OF_FILE)
+			{
+				break;
+			}
+			lexer.next_token();
+		}
+		stats->num_bytes = lexer.base_offset + lexer.len;
+		stats->max_buffer_size = lexer.buf.size();
+		std::fclose(file);
+		return true;
+	}
+}
\ No newline at end of file
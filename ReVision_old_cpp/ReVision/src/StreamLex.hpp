@@ -0,0 +1,75 @@
+#pragma once
+#include "Lex.hpp"
+
+namespace ReVision
+{
+	#define STREAM_DEFAULT_CHUNK_SIZE (1 << 20)
+
+	// Reads up to max_len bytes into dst, returning 0 only at the end of the input.
+	typedef size_t (*StreamRead)(void *user, char *dst, size_t max_len);
+	// StreamRead over a FILE *.
+	size_t stream_read_file(void *file, char *dst, size_t max_len);
+
+	// Lexes an input of any size through a buffer of about two chunks, for
+	// sources too big to map or load whole. Input is pulled one chunk at a time
+	// and the unconsumed tail is moved to the front before each read, so a token
+	// cut by a chunk boundary is lexed again once the rest of it is in. A token
+	// counts as complete only when more than RELEX_LOOKAHEAD bytes follow it or
+	// the input has ended. Whitespace and comments, nested block comments
+	// included, are skipped in stream with their state carried across reads,
+	// so they never need to fit in the buffer. So are invalid chars, which the
+	// lexer would otherwise skip along with the trivia after them. A single
+	// token longer than a chunk grows the buffer to hold it, the interned value
+	// needs as much anyway.
+	// Names and strings are interned only once their token is complete, so a
+	// token lexed twice never leaves a cut-off name behind in interns.
+	struct StreamLexer
+	{
+		// lexer.token is the current token. Its start and end point into the buffer
+		// and stay valid until the next call, token.pos is relative to the buffer.
+		Lexer lexer;
+		// Used for complete tokens, lexer.intern_range only records the range.
+		const char *(*intern_range)(const char *start, const char *end, InternId *id) = str_intern_range;
+		const char *name;
+		StreamRead read;
+		void *user;
+		size_t chunk_size;
+		std::vector<char> buf;
+		// Bytes in buf, buf[len] is the '\0' sentinel
+		size_t len;
+		// Offset in the whole input of buf[0]
+		uint64_t base_offset;
+		// Offset in the whole input up to which bytes were counted as lexed
+		uint64_t counted_offset;
+		int comment_depth;
+		bool in_line_comment;
+		bool at_eof;
+
+		// Reads the first chunk and lexes the first token.
+		void init(const char *name, StreamRead read, void *user, size_t chunk_size = STREAM_DEFAULT_CHUNK_SIZE);
+		void next_token();
+		// Offset of the current token in the whole input.
+		uint64_t token_offset() const { return base_offset + static_cast<uint64_t>(lexer.token.start - buf.data()); }
+
+	private:
+		// Keeps [keep_from, end of buffer) and appends the next chunk after it.
+		void refill(const char *keep_from);
+		void skip_trivia();
+		// Lexes a token without the lexer's stats counting it, as it may be lexed again.
+		// Accepted tokens and the bytes before them, trivia included, are counted once.
+		void lex_uncounted();
+	};
+
+	struct StreamLexStats
+	{
+		uint64_t num_bytes;
+		uint64_t num_tokens;
+		// Largest the buffer got, the bound on memory used for the input
+		size_t max_buffer_size;
+	};
+
+	// Streams a whole file through a StreamLexer, handing every token to on_token as it is lexed.
+	// Returns false if the file could not be opened.
+	bool stream_lex_file(const char *path, size_t chunk_size, StreamLexStats *stats,
+		void (*on_token)(void *user, const StreamLexer &lexer) = nullptr, void *user = nullptr);
+}
\ No newline at end of file
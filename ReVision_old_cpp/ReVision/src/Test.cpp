@@ -2,6 +2,79 @@
 
 namespace ReVision
 {
+	void arena_test()
+	{
+		Arena arena;
+		assert(arena_stats(&arena).num_blocks == 0);
+
+		// Blocks grow geometrically, so a megabyte of small allocations only needs a handful
+		for (int i{ 0 }; i < 1024 * 1024 / 16; ++i)
+		{
+			std::memset(arena_alloc(&arena, 16), i, 16);
+		}
+		ArenaStats stats{ arena_stats(&arena) };
+		assert(stats.bytes_used == 1024 * 1024 && stats.bytes_reserved >= stats.bytes_used);
+		assert(stats.num_blocks < 16);
+
+		// Scratch allocations after a mark are released without giving back blocks
+		const ArenaMark mark{ arena_mark(&arena) };
+		char *first{ static_cast<char *>(arena_alloc(&arena, 100)) };
+		arena_alloc(&arena, 3 * ARENA_MAX_BLOCK_SIZE);
+		const size_t num_blocks{ arena_stats(&arena).num_blocks };
+		arena_reset_to_mark(&arena, mark);
+		assert(arena_stats(&arena).bytes_used == 1024 * 1024);
+		assert(arena_stats(&arena).num_blocks == num_blocks);
+		assert(arena_alloc(&arena, 100) == first);
+
+		// A reset keeps every block, the same amount of work afterwards allocates nothing new
+		const size_t reserved{ arena_stats(&arena).bytes_reserved };
+		arena_reset(&arena);
+		assert(arena_stats(&arena).bytes_used == 0);
+		for (int i{ 0 }; i < 1024 * 1024 / 16; ++i)
+		{
+			arena_alloc(&arena, 16);
+		}
+		arena_alloc(&arena, 3 * ARENA_MAX_BLOCK_SIZE);
+		assert(arena_stats(&arena).bytes_reserved == reserved);
+
+		// Moving blocks keeps the contents and leaves the source reusable
+		Arena other;
+		char *moved{ static_cast<char *>(arena_alloc(&other, 6)) };
+		std::memcpy(moved, "moved", 6);
+		const size_t used{ arena_stats(&arena).bytes_used };
+		arena_move_blocks(&arena, &other);
+		assert(std::strcmp(moved, "moved") == 0);
+		assert(arena_stats(&arena).bytes_used == used + 6);
+		assert(arena_stats(&other).bytes_used == 0 && arena_stats(&other).num_blocks == 0);
+		arena_alloc(&arena, 8);
+
+		arena_free(&arena);
+		arena_free(&other);
+		stats = arena_stats(&arena);
+		assert(stats.bytes_used == 0 && stats.bytes_reserved == 0 && stats.num_blocks == 0);
+		assert(arena_alloc(&arena, 8));
+		arena_free(&arena);
+
+		// A reserved arena commits as it goes and only mallocs once the reservation is full
+		Arena vm_arena;
+		if (arena_init_reserved(&vm_arena, 2 * ARENA_COMMIT_SIZE))
+		{
+			char *base{ static_cast<char *>(arena_alloc(&vm_arena, 16)) };
+			assert(base == vm_arena.reserve_base);
+			std::memset(arena_alloc(&vm_arena, ARENA_COMMIT_SIZE), 1, ARENA_COMMIT_SIZE);
+			assert(arena_stats(&vm_arena).num_blocks == 1);
+			assert(arena_stats(&vm_arena).bytes_reserved == 2 * ARENA_COMMIT_SIZE);
+			arena_alloc(&vm_arena, ARENA_COMMIT_SIZE);
+			assert(arena_stats(&vm_arena).num_blocks == 2);
+
+			arena_move_blocks(&vm_arena, &other);
+			arena_reset(&vm_arena);
+			assert(arena_alloc(&vm_arena, 16) == base);
+			arena_free(&vm_arena);
+			assert(!vm_arena.reserve_base && arena_stats(&vm_arena).num_blocks == 0);
+		}
+	}
+
 	void str_intern_test()
 	{
 		char a[] = "hello";
@@ -15,18 +88,121 @@ namespace ReVision
 		assert(str_intern(a) != str_intern(c));
 		char d[] = "hell";
 		assert(str_intern(a) != str_intern(d));
+
+		// Force a few rehashes and make sure every name survives them
+		std::vector<const char *> names;
+		char buf[16];
+		for (int i{ 0 }; i < 4096; ++i)
+		{
+			std::snprintf(buf, sizeof(buf), "name%d", i);
+			names.push_back(str_intern(buf));
+		}
+		for (int i{ 0 }; i < 4096; ++i)
+		{
+			std::snprintf(buf, sizeof(buf), "name%d", i);
+			assert(str_intern(buf) == names[i]);
+			assert(strcmp(buf, names[i]) == 0);
+		}
+		assert(str_intern(a) == str_intern(b));
+	}
+
+	void concurrent_intern_test()
+	{
+		std::vector<std::string> names;
+		for (int i{ 0 }; i < 2000; ++i)
+		{
+			names.push_back("shard_name" + std::to_string(i * 7919 % 2000));
+		}
+		const char *builtin{ str_intern("shard_builtin") };
+		names.push_back("shard_builtin");
+
+		// Every worker interns all names, each starting at a different offset
+		const size_t num_workers{ 8 };
+		std::vector<std::vector<const char *>> results(num_workers, std::vector<const char *>(names.size()));
+		std::vector<std::vector<InternId>> ids(num_workers, std::vector<InternId>(names.size()));
+		ThreadPool pool(num_workers);
+		pool.parallel_for(num_workers, [&](size_t, size_t task)
+		{
+			for (size_t i{ 0 }; i < names.size(); ++i)
+			{
+				const size_t j{ (i + task * 251) % names.size() };
+				const std::string &name{ names[j] };
+				results[task][j] = str_intern_range_concurrent(name.data(), name.data() + name.size(), &ids[task][j]);
+			}
+		});
+		for (size_t i{ 0 }; i < names.size(); ++i)
+		{
+			for (size_t task{ 1 }; task < num_workers; ++task)
+			{
+				assert(results[task][i] == results[0][i] && ids[task][i] == ids[0][i]);
+			}
+			InternId id;
+			assert(results[0][i] == str_intern_range_concurrent(names[i].data(), names[i].data() + names[i].size(), &id));
+			assert(id == ids[0][i] && intern_id_of(results[0][i]) == id);
+		}
+		assert(results[0].back() == builtin && ids[0].back() == intern_id(builtin));
+
+		// The final order only depends on the set of names
+		std::vector<std::string> expected(names.begin(), names.end() - 1);
+		std::sort(expected.begin(), expected.end());
+		const InternId first_id{ static_cast<InternId>(interns.size()) };
+		const InternRemap remap{ merge_concurrent_interns() };
+		assert(interns.size() == first_id + expected.size());
+		for (size_t i{ 0 }; i < expected.size(); ++i)
+		{
+			const InternId id{ first_id + static_cast<InternId>(i) };
+			assert(expected[i] == intern_str(id));
+			assert(intern_len(id) == expected[i].size());
+			assert(str_intern(intern_str(id)) == intern_str(id) && intern_id_of(intern_str(id)) == id);
+		}
+		for (size_t i{ 0 }; i < names.size(); ++i)
+		{
+			assert(intern_str(remap.resolve(ids[0][i])) == results[0][i]);
+		}
+		assert(concurrent_interns_sorted().empty());
 	}
 
 	void keyword_test()
 	{
 		init_keywords();
-		assert(is_keyword_name(first_keyword));
-		assert(is_keyword_name(last_keyword));
+		for (InternId id{ 0 }; id < NUM_KEYWORDS; ++id)
+		{
+			assert(intern_id_of(keywords[id]) == id && intern_id(keyword_names[id]) == id);
+			assert(is_keyword_id(id));
+		}
+		assert(!is_keyword_id(intern_id("foo")));
+		assert(intern_len(intern_id("foo")) == 3 && intern_hash(intern_id("foo")) == hash_bytes("foo", 3));
 		for (const char *str : keywords)
 		{
 			assert(is_keyword_name(str));
 		}
 		assert(!is_keyword_name(str_intern("foo")));
+
+		// The perfect hash finds every keyword and nothing else, including names
+		// that share a keyword's hash key and only differ in the middle
+		for (uint32_t id{ 0 }; id < NUM_KEYWORDS; ++id)
+		{
+			assert(keyword_id_of(keyword_names[id], keyword_lens[id]) == id);
+		}
+		const char *not_keywords[]{ "i", "iff", "fo", "forr", "typedeff", "typede", "Typedef", "enums", "dp", "jmq", "f", "returm", "defaulr", "whilewhile", "_if", "retuxn", "wxile" };
+		for (const char *str : not_keywords)
+		{
+			assert(keyword_id_of(str, std::strlen(str)) == NUM_KEYWORDS);
+		}
+		assert(keyword_id_of("ifx", 2) == if_keyword_id);
+		assert(keyword_id_of("a_very_long_identifier_name", 27) == NUM_KEYWORDS);
+
+		// The reserved keywords still commented out of KEYWORD_LIST must get a
+		// perfect hash too, so enabling them is only a matter of uncommenting.
+		constexpr const char *all_keyword_names[]{
+			#define KEYWORD_NAME(name) #name,
+			KEYWORD_LIST(KEYWORD_NAME)
+			#undef KEYWORD_NAME
+			"asm", "jmpif", "use", "class", "namespace", "new", "delete",
+		};
+		constexpr size_t num_all_keywords{ sizeof(all_keyword_names) / sizeof(all_keyword_names[0]) };
+		static_assert(make_keyword_hash_table(all_keyword_names, num_all_keywords).multiplier != 0,
+			"no perfect hash once the reserved keywords are added");
 	}
 
 	#define assert_token(x) assert(match_token(x))
@@ -69,6 +245,15 @@ namespace ReVision
 		assert_token_str("a\nb");
 		assert_token_eof();
 
+		// Escape free literals are interned straight from the source, '\0' escapes are kept
+		init_stream(nullptr, "\"plain\" \"a\\0b\\0\" \"\" \"x\\ty\"");
+		assert(token.str_val == str_intern("plain") && match_token(Token::STR));
+		assert(intern_len(token.name_id) == 4 && std::memcmp(token.str_val, "a\0b\0", 5) == 0);
+		assert(token.str_val != str_intern("a") && match_token(Token::STR));
+		assert(token.str_val == str_intern("") && match_token(Token::STR));
+		assert_token_str("x\ty");
+		assert_token_eof();
+
 		// Operator tests
 		init_stream(nullptr,
 			": ( ) { } [ ] , . @ # ... ? ; \n"
@@ -159,6 +344,22 @@ namespace ReVision
 		assert_token(Token::ADD);
 		assert_token_int(994);
 		assert_token_eof();
+
+		// Two interleaved lexers don't share any state
+		Lexer a;
+		Lexer b;
+		a.init_stream("a", "foo 1 + 2");
+		b.init_stream("b", "bar\n(3)");
+		assert(a.is_token_name(str_intern("foo")) && a.match_token(Token::NAME));
+		assert(b.is_token_name(str_intern("bar")) && b.match_token(Token::NAME));
+		assert(resolve_pos(b.token.pos).line == 2 && b.match_token(Token::LPAREN));
+		assert(a.token.int_val == 1 && a.match_token(Token::INT));
+		assert(a.match_token(Token::ADD));
+		assert(b.token.int_val == 3 && b.match_token(Token::INT));
+		assert(a.token.int_val == 2 && a.match_token(Token::INT));
+		assert(b.match_token(Token::RPAREN));
+		assert(a.is_token(Token::END_OF_FILE) && b.is_token(Token::END_OF_FILE));
+		assert(resolve_pos(a.token.pos).line == 1 && resolve_pos(a.token.pos).col == 10);
 	}
 	#undef assert_token
 	#undef assert_token_name
@@ -167,10 +368,928 @@ namespace ReVision
 	#undef assert_token_str
 	#undef assert_token_eof
 
+	void scan_kernels_test()
+	{
+		// Random mixes of the characters the kernels care about, at every alignment
+		const char alphabet[]{ " \t\n\r\v\f/*ab_Z09@`{\x80\xff" };
+		uint32_t rng{ 12345 };
+		std::vector<char> buf(256 + 64);
+		for (int round{ 0 }; round < 200; ++round)
+		{
+			char *text{ static_cast<char *>(ALIGN_UP_PTR(buf.data(), 32)) };
+			const size_t len{ static_cast<size_t>(round % 130) };
+			for (size_t i{ 0 }; i < len; ++i)
+			{
+				rng = rng * 1664525 + 1013904223;
+				// Long runs of one class now and then, so whole blocks get skipped
+				const size_t pick{ (rng >> 24) % (round % 3 == 0 ? 5 : sizeof(alphabet) - 1) };
+				text[i] = alphabet[pick];
+			}
+			text[len] = 0;
+			for (size_t start{ 0 }; start < len; ++start)
+			{
+				const char *ref_space{ scalar_kernels.skip_space(text + start) };
+				const char *ref_eol{ scalar_kernels.skip_line(text + start) };
+				const char *ref_delim{ scalar_kernels.skip_to_comment_delim(text + start) };
+				const char *ref_ident{ scalar_kernels.skip_ident(text + start) };
+				const char *ref_digits{ scalar_kernels.skip_digits(text + start) };
+				std::vector<uint32_t> ref_newlines;
+				assert(scalar_kernels.find_newlines(text + start, &ref_newlines) == text + len);
+				for (const ScanKernels *kernels : supported_scan_kernels())
+				{
+					assert(kernels->skip_space(text + start) == ref_space);
+					assert(kernels->skip_line(text + start) == ref_eol);
+					assert(kernels->skip_to_comment_delim(text + start) == ref_delim);
+					assert(kernels->skip_ident(text + start) == ref_ident);
+					assert(kernels->skip_digits(text + start) == ref_digits);
+					std::vector<uint32_t> newlines;
+					assert(kernels->find_newlines(text + start, &newlines) == text + len);
+					assert(newlines == ref_newlines);
+				}
+			}
+		}
+
+		// The table agrees with <cctype> in the C locale
+		for (int c{ 0 }; c < 128; ++c)
+		{
+			assert(is_space_char(static_cast<char>(c)) == (std::isspace(c) != 0));
+			assert(is_digit_char(static_cast<char>(c)) == (std::isdigit(c) != 0));
+			assert(is_ident_char(static_cast<char>(c)) == (std::isalnum(c) != 0 || c == '_'));
+			assert(char_is(static_cast<char>(c), CHAR_HEX) == (std::isxdigit(c) != 0));
+		}
+
+		// Numbers and names found through the run scanners
+		init_stream(nullptr, "1.5e+3 10e2 7. 0x1F 007 0 12345678901234567890123 abc_123 _x9 Z");
+		assert(token.float_val == 1.5e+3 && match_token(Token::FLOAT));
+		assert(token.float_val == 10e2 && match_token(Token::FLOAT));
+		assert(token.float_val == 7. && match_token(Token::FLOAT));
+		assert(token.int_val == 0x1F && token.mod == Token::Mod::HEX && match_token(Token::INT));
+		assert(token.int_val == 7 && token.mod == Token::Mod::OCT && match_token(Token::INT));
+		assert(token.int_val == 0 && token.end - token.start == 1 && match_token(Token::INT));
+		assert(token.int_val == 0 && *token.end == ' ' && match_token(Token::INT)); // Overflow
+		assert(is_token_name(str_intern("abc_123")) && match_token(Token::NAME));
+		assert(is_token_name(str_intern("_x9")) && match_token(Token::NAME));
+		assert(is_token_name(str_intern("Z")) && match_token(Token::NAME));
+		assert(is_token(Token::END_OF_FILE));
+
+		// Line counting across comments, nested comments included
+		init_stream(nullptr,
+			"a /* one\n /* two\n */ still\n comment */ b // tail\n"
+			"\t\t   \n\n          c /*/ x */ d\n/**/e");
+		assert(resolve_pos(token.pos).line == 1 && match_token(Token::NAME));
+		assert(resolve_pos(token.pos).line == 4 && is_token_name(str_intern("b")) && match_token(Token::NAME));
+		assert(resolve_pos(token.pos).line == 7 && is_token_name(str_intern("c")) && match_token(Token::NAME));
+		assert(resolve_pos(token.pos).line == 7 && resolve_pos(token.pos).col == 22 && is_token_name(str_intern("d")) && match_token(Token::NAME));
+		const SrcLoc last{ resolve_pos(token.pos) };
+		assert(last.line == 8 && last.col == 5 && std::strcmp(last.name, "<string>") == 0 && match_token(Token::NAME));
+		assert(is_token(Token::END_OF_FILE) && resolve_pos(token.pos).col == 6);
+		const SrcLoc builtin{ resolve_pos(pos_builtin) };
+		assert(builtin.line == 0 && std::strcmp(builtin.name, "<builtin>") == 0);
+	}
+
+	void token_buffer_test()
+	{
+		const char *text{ "func f(x) {\n  return x * 2.5 + 0x10; // done\n}\n\"s\"" };
+		TokenBuffer buf;
+		Lexer lexer;
+		tokenize_all(&lexer, "buf", text, &buf);
+
+		// The buffer holds exactly what the lexer produced, END_OF_FILE included
+		lexer.init_stream("buf", text);
+		for (size_t i{ 0 }; i < buf.size(); ++i)
+		{
+			const Token t{ buf.token_at(i) };
+			assert(t.kind == lexer.token.kind && t.mod == lexer.token.mod);
+			assert(t.start == lexer.token.start && t.end == lexer.token.end && t.pos.offset == lexer.token.pos.offset);
+			if (t.kind == Token::INT || t.kind == Token::FLOAT || t.kind == Token::NAME || t.kind == Token::KEYWORD || t.kind == Token::STR)
+			{
+				assert(t.int_val == lexer.token.int_val);
+			}
+			lexer.next_token();
+		}
+		assert(buf.kinds.back() == Token::END_OF_FILE);
+		assert(buf.int_vals.size() == 1 && buf.float_vals.size() == 1);
+
+		TokenCursor cursor(&buf);
+		assert(cursor.match_keyword(func_keyword));
+		assert(cursor.is_token_name(str_intern("f")) && cursor.expect_token(Token::NAME));
+		assert(cursor.expect_token(Token::LPAREN));
+		assert(cursor.match_token(Token::NAME));
+		assert(cursor.match_token(Token::RPAREN) && cursor.match_token(Token::LBRACE));
+		assert(resolve_pos(cursor.pos()).line == 2 && cursor.match_keyword(return_keyword));
+		assert(cursor.match_token(Token::NAME) && cursor.match_token(Token::MUL));
+		assert(cursor.float_val() == 2.5 && cursor.match_token(Token::FLOAT));
+		assert(cursor.match_token(Token::ADD));
+		assert(cursor.int_val() == 0x10 && cursor.match_token(Token::INT));
+		assert(cursor.match_token(Token::SEMICOLON));
+		assert(resolve_pos(cursor.pos()).line == 3 && cursor.match_token(Token::RBRACE));
+		assert(std::strcmp(cursor.str_val(), "s") == 0 && cursor.match_token(Token::STR));
+		assert(cursor.is_token(Token::END_OF_FILE));
+		cursor.next_token();
+		assert(cursor.is_token(Token::END_OF_FILE));
+	}
+
+	void driver_test()
+	{
+		std::vector<std::string> texts;
+		for (int i{ 0 }; i < 32; ++i)
+		{
+			std::string text;
+			for (int j{ 0 }; j < 50 * (i + 1); ++j)
+			{
+				text += "file" + std::to_string(i) + "_name" + std::to_string(j) + " := " + std::to_string(j) + "; // x\n";
+			}
+			texts.push_back(text);
+		}
+
+		std::vector<SourceFile> serial;
+		std::vector<SourceFile> parallel;
+		for (std::string &text : texts)
+		{
+			serial.push_back(SourceFile{ "serial", text.c_str(), text.size(), {}, {} });
+			parallel.push_back(SourceFile{ "parallel", text.c_str(), text.size(), {}, {} });
+		}
+		const LexStats serial_stats{ lex_files(serial, 1) };
+		const LexStats parallel_stats{ lex_files(parallel, 8) };
+		assert(serial_stats.num_files == 32 && parallel_stats.num_files == 32);
+		assert(serial_stats.num_tokens == parallel_stats.num_tokens);
+		for (size_t i{ 0 }; i < serial.size(); ++i)
+		{
+			assert(serial[i].tokens.size() == parallel[i].tokens.size());
+			assert(serial[i].tokens.kinds.back() == Token::END_OF_FILE);
+			for (size_t j{ 0 }; j < serial[i].tokens.size(); ++j)
+			{
+				const Token a{ serial[i].tokens.token_at(j) };
+				const Token b{ parallel[i].tokens.token_at(j) };
+				assert(a.kind == b.kind && a.start == b.start && a.end == b.end && a.pos.offset == b.pos.offset);
+				assert(a.kind != Token::NAME || a.name == b.name);
+			}
+		}
+	}
+
+	void source_map_test()
+	{
+		const size_t page{ page_size() };
+		const size_t sizes[]{ 0, 1, page - 1, page, 2 * page, 2 * page + 3 };
+		const char *path{ "revision_source_map_test.tmp" };
+		for (size_t size : sizes)
+		{
+			std::string text;
+			for (size_t i{ 0 }; i < size; ++i)
+			{
+				text += (i % 16 == 15) ? '\n' : static_cast<char>('a' + i % 26);
+			}
+			FILE *file{ std::fopen(path, "wb") };
+			assert(file);
+			std::fwrite(text.data(), 1, text.size(), file);
+			std::fclose(file);
+
+			SourceMap map;
+			assert(source_map(&map, path));
+			assert(map.len == size);
+			assert(std::memcmp(map.text, text.data(), size) == 0);
+			assert(map.text[size] == 0);
+			assert(size == 0 ? map.backing == SourceMap::Backing::NONE : map.backing != SourceMap::Backing::NONE);
+
+			Lexer lexer;
+			lexer.init_stream(path, map.text);
+			while (!lexer.is_token(Token::END_OF_FILE))
+			{
+				assert(map.text <= lexer.token.start && lexer.token.end <= map.text + size);
+				lexer.next_token();
+			}
+			source_unmap(&map);
+		}
+		std::remove(path);
+
+		SourceMap missing;
+		assert(!source_map(&missing, "revision_source_map_test.missing"));
+	}
+
+	static void check_float_literal(const char *text)
+	{
+		const char *int_end{ text };
+		while (is_digit_char(*int_end)) { ++int_end; }
+		const FloatLiteral lit{ parse_float_literal(text, int_end) };
+		char *strtod_end;
+		const double expected{ std::strtod(text, &strtod_end) };
+		assert(lit.end == strtod_end);
+		assert(!lit.bad_exponent);
+		assert(std::memcmp(&lit.val, &expected, sizeof(double)) == 0);
+	}
+
+	void float_literal_test()
+	{
+		const char *literals[]{
+			"0.0", "1.0", "0.1", "3.14159", "1e10", "1E-10", "1.5e+3", "123.", "0.000001",
+			"9007199254740992.0", "9007199254740993.0", "9007199254740995.0",
+			"1e22", "1e23", "1e-22", "1e-23", "1e308", "1.7976931348623157e308",
+			"2.2250738585072014e-308", "2.2250738585072011e-308", "4.9406564584124654e-324",
+			"2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "0e999999999",
+			"0.30000000000000004", "1.00000000000000011102230246251565404236316680908203125",
+			"1.00000000000000011102230246251565404236316680908203124",
+			"1.00000000000000011102230246251565404236316680908203126",
+			"123456789012345678901234567890.0", "0.000000000000000000000000000000000012345678901234567890123",
+			"7.2057594037927933e16", "5.0e-324", "1e-325", "8.98846567431158e307",
+		};
+		for (const char *text : literals)
+		{
+			check_float_literal(text);
+		}
+
+		const char *overflow{ "1e400" };
+		const FloatLiteral huge{ parse_float_literal(overflow, overflow + 1) };
+		assert(std::isinf(huge.val));
+		const char *bad{ "1.5e+x" };
+		const FloatLiteral missing{ parse_float_literal(bad, bad + 1) };
+		assert(missing.bad_exponent == bad + 5);
+
+		// Round trips of random doubles and random digit strings
+		uint64_t seed{ 0x9E3779B97F4A7C15ull };
+		auto next_random{ [&seed]() {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			return seed;
+		} };
+		char buf[64];
+		for (int i{ 0 }; i < 100000; ++i)
+		{
+			const uint64_t bits{ next_random() & 0x7FFFFFFFFFFFFFFFull };
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			if (!std::isfinite(d)) { continue; }
+			std::snprintf(buf, sizeof(buf), (i & 1) ? "%.*e" : "%.*g", static_cast<int>(next_random() % 17) + 1, d);
+			if (!is_digit_char(buf[0])) { continue; }
+			check_float_literal(buf);
+		}
+		for (int i{ 0 }; i < 20000; ++i)
+		{
+			std::string text;
+			const size_t int_digits{ next_random() % 25 + 1 }, frac_digits{ next_random() % 25 };
+			for (size_t j{ 0 }; j < int_digits; ++j) { text += static_cast<char>('0' + next_random() % 10); }
+			text += '.';
+			for (size_t j{ 0 }; j < frac_digits; ++j) { text += static_cast<char>('0' + next_random() % 10); }
+			text += 'e';
+			text += std::to_string(static_cast<int>(next_random() % 700) - 350);
+			check_float_literal(text.c_str());
+		}
+	}
+
+	void int_literal_test()
+	{
+		Lexer lexer;
+		auto check{ [&lexer](const std::string &text, uint64_t expected, Token::Mod mod) {
+			lexer.init_stream(nullptr, text.c_str());
+			assert(lexer.token.kind == Token::INT && lexer.token.mod == mod && lexer.token.int_val == expected);
+			lexer.next_token();
+			assert(lexer.is_token(Token::END_OF_FILE));
+		} };
+		auto to_base{ [](uint64_t val, uint64_t base, size_t min_digits) {
+			std::string digits;
+			for (; val || digits.size() < min_digits; val /= base)
+			{
+				digits += "0123456789abcdef"[val % base];
+			}
+			return std::string(digits.rbegin(), digits.rend());
+		} };
+
+		const uint64_t max{ std::numeric_limits<uint64_t>::max() };
+		check("18446744073709551615", max, Token::Mod::NONE);
+		check("0xFFFFFFFFffffffff", max, Token::Mod::HEX);
+		check("0x0000000000000000000000ffffffffffffffff", max, Token::Mod::HEX);
+		check("01777777777777777777777", max, Token::Mod::OCT);
+		check("0b" + to_base(max, 2, 0), max, Token::Mod::BIN);
+		check("0x", 0, Token::Mod::HEX);
+		check("0b", 0, Token::Mod::BIN);
+
+		// Overflow and bad digits are rescanned one character at a time, with the old diagnostics and values
+		check("18446744073709551616", 0, Token::Mod::NONE);
+		check("0x10000000000000000", 0, Token::Mod::HEX);
+		check("02000000000000000000000", 0, Token::Mod::OCT);
+		check("0b1012", 0xA, Token::Mod::BIN);
+		check("0129", 0120, Token::Mod::OCT);
+
+		uint64_t seed{ 0x2545F4914F6CDD1Dull };
+		auto next_random{ [&seed]() {
+			seed ^= seed << 13;
+			seed ^= seed >> 7;
+			seed ^= seed << 17;
+			return seed;
+		} };
+		for (int i{ 0 }; i < 100000; ++i)
+		{
+			// Spread the values over every digit count
+			const uint64_t val{ next_random() >> (next_random() % 64) };
+			check(std::to_string(val), val, Token::Mod::NONE);
+			check("0x" + to_base(val, 16, next_random() % 20), val, Token::Mod::HEX);
+			check("0b" + to_base(val, 2, next_random() % 70), val, Token::Mod::BIN);
+			if (val)
+			{
+				check("0" + to_base(val, 8, next_random() % 25), val, Token::Mod::OCT);
+			}
+		}
+	}
+
+	void ast_test()
+	{
+		init_keywords();
+		static_assert(sizeof(AstNode) == 16, "AstNode should stay 16 bytes");
+
+		// func add(a: int, b: int): int { return a + b * 2; }
+		Ast ast;
+		const InternId int_id{ intern_id(str_intern("int")) };
+		const InternId a_id{ intern_id(str_intern("a")) }, b_id{ intern_id(str_intern("b")) };
+		const TypespecId int_type{ ast.add_typespec(TYPESPEC_NAME, 1, int_id) };
+		const ExprId mul{ ast.add_expr(EXPR_BINARY, 1, ast.add_expr(EXPR_NAME, 1, b_id), ast.add_int(1, 2), 0, Token::MUL) };
+		const ExprId add{ ast.add_expr(EXPR_BINARY, 1, ast.add_expr(EXPR_NAME, 1, a_id), mul, 0, Token::ADD) };
+		const StmtId ret{ ast.add_stmt(STMT_RETURN, 1, add) };
+		const StmtId body{ ast.add_stmt(STMT_BLOCK, 1, ast.add_list(&ret, 1), 1) };
+		const uint32_t func_list[]{ int_type, body, 2, a_id, int_type, b_id, int_type };
+		const DeclId func{ ast.add_decl(DECL_FUNC, 1, intern_id(str_intern("add")), ast.add_list(func_list, 7)) };
+		ast.file_decls.push_back(func);
+
+		const AstNode &decl{ ast.decls[ast.file_decls[0]] };
+		assert(decl.kind == DECL_FUNC && std::strcmp(intern_str(decl.a), "add") == 0);
+		const uint32_t *items{ ast.list(decl.b) };
+		assert(items[2] == 2 && items[3] == a_id && items[5] == b_id);
+		const AstNode &block{ ast.stmts[items[1]] };
+		assert(block.kind == STMT_BLOCK && block.b == 1);
+		const AstNode &sum{ ast.exprs[ast.stmts[ast.list(block.a)[0]].a] };
+		assert(sum.kind == EXPR_BINARY && sum.op == Token::ADD);
+		const AstNode &product{ ast.exprs[sum.b] };
+		assert(product.op == Token::MUL && ast.int_vals[ast.exprs[product.b].a] == 2);
+		assert(ast.exprs[NULL_AST_ID].kind == EXPR_NONE && ast.typespecs[int_type].a == int_id);
+
+		// Clearing keeps the null nodes and the capacity
+		const size_t capacity{ ast.exprs.nodes.capacity() };
+		ast.clear();
+		assert(ast.exprs.size() == 1 && ast.stmts.size() == 1 && ast.decls.size() == 1 && ast.typespecs.size() == 1);
+		assert(ast.lists.empty() && ast.file_decls.empty() && ast.exprs.nodes.capacity() == capacity);
+	}
+
+	void parse_expr_test()
+	{
+		init_keywords();
+		Parser parser;
+		Ast ast;
+		auto check{ [&](const char *text, const char *expected) {
+			const ExprId expr{ parse_expr_str(&parser, text, &ast) };
+			const std::string printed{ expr_to_string(ast, expr) };
+			assert(printed == expected);
+			assert(parser.frames.empty() && parser.scratch.empty());
+		} };
+
+		check("1 + 2 * 3", "(+ 1 (* 2 3))");
+		check("a - b - c", "(- (- a b) c)");
+		check("a << 1 | b & c", "(| (<< a 1) (& b c))");
+		check("a == b && c < d || e", "(|| (&& (== a b) (< c d)) e)");
+		check("(a + b) * c", "(* (+ a b) c)");
+		check("-a * ~b + !c", "(+ (* (- a) (~ b)) (! c))");
+		check("*p++ + &x", "(+ (* (++ post p)) (& x))");
+		check("--i", "(-- i)");
+		check("a ? b : c ? d : e", "(? a b (? c d e))");
+		check("a || b ? c + 1 : d", "(? (|| a b) (+ c 1) d)");
+		check("f(a, b + 1)(c)[i].x", "(field (index ((f a (+ b 1)) c) i) x)");
+		check("f()", "(f)");
+		check("-f(x)[0]", "(- (index (f x) 0))");
+		check("Vec2{1, 2.5,}", "(compound Vec2 1 2.5)");
+		check("{}", "(compound nil)");
+		check("{ {1}, \"s\" }", "(compound nil (compound nil 1) \"s\")");
+		check("sizeof(:int*[4]) + sizeof(a[1])", "(+ (sizeof :(array (ptr int) 4)) (sizeof (index a 1)))");
+		check("alignof(:func(int, char*): int) + offsetof(Vec2, y)", "(+ (alignof :(func (int (ptr char)) int)) (offsetof Vec2 y))");
+		check("typeof(1 ? x : y)", "(typeof (? 1 x y))");
+
+		// Nesting depth only grows the frame stack, never the native stack
+		std::string deep;
+		for (int i{ 0 }; i < 200000; ++i) { deep += "-("; }
+		deep += "x";
+		for (int i{ 0 }; i < 200000; ++i) { deep += ')'; }
+		ExprId expr{ parse_expr_str(&parser, deep.c_str(), &ast) };
+		for (int i{ 0 }; i < 200000; ++i)
+		{
+			assert(ast.exprs[expr].kind == EXPR_UNARY && ast.exprs[expr].op == Token::SUB);
+			expr = ast.exprs[expr].a;
+		}
+		assert(ast.exprs[expr].kind == EXPR_NAME);
+	}
+
+	void parse_file_test()
+	{
+		init_keywords();
+		const char *text{
+			"import std.io;\n"
+			"const N: int = 16;\n"
+			"typedef Table = int[N]*;\n"
+			"struct Vec2 { x, y: float; tag: char const*; }\n"
+			"union Bits { i: int; f: float; }\n"
+			"enum Color { RED, GREEN = 2, BLUE, }\n"
+			"counter := 0;\n"
+			"origin: Vec2 = Vec2{0, 0};\n"
+			"func printf(fmt: char*, ...): int;\n"
+			"func sum(v: Vec2*, n: int): float\n"
+			"{\n"
+			"    total: float = 0.0;\n"
+			"    for (i := 0; i < n; i++) { total += v[i].x * v[i].y; }\n"
+			"    while (total > 100.0) total /= 2;\n"
+			"    do { --n; } while (n);\n"
+			"    if (n == 1) { return 1; } else if (n == 2) return 2; else { ; }\n"
+			"    switch (n) { case 1, 2: counter++; break; default: jmp done; }\n"
+			"    :done\n"
+			"    func helper(): int { return sizeof(:Vec2); }\n"
+			"    return total;\n"
+			"}\n"
+		};
+		Parser parser;
+		Ast ast;
+		parse_file(&parser, "<file>", text, &ast);
+		assert(parser.frames.empty() && parser.scratch.empty());
+
+		const DeclKind kinds[]{ DECL_IMPORT, DECL_CONST, DECL_TYPEDEF, DECL_STRUCT, DECL_UNION, DECL_ENUM, DECL_VAR, DECL_VAR, DECL_FUNC, DECL_FUNC };
+		assert(ast.file_decls.size() == sizeof(kinds) / sizeof(kinds[0]));
+		for (size_t i{ 0 }; i < ast.file_decls.size(); ++i)
+		{
+			assert(ast.decls[ast.file_decls[i]].kind == kinds[i]);
+			assert(ast.loc(ast.decls, ast.file_decls[i]).line == static_cast<int>(i) + 1);
+		}
+
+		const AstNode &import{ ast.decls[ast.file_decls[0]] };
+		assert(import.b == 2 && std::strcmp(intern_str(ast.list(import.a)[1]), "io") == 0);
+		std::string printed;
+		print_typespec(ast, ast.decls[ast.file_decls[2]].b, &printed);
+		assert(printed == "(ptr (array int N))");
+		const AstNode &vec2{ ast.decls[ast.file_decls[3]] };
+		assert(vec2.c == 3 && std::strcmp(intern_str(ast.list(vec2.b)[2]), "y") == 0 && ast.list(vec2.b)[1] == ast.list(vec2.b)[3]);
+		const AstNode &color{ ast.decls[ast.file_decls[5]] };
+		assert(color.c == 3 && ast.int_vals[ast.exprs[ast.list(color.b)[3]].a] == 2 && ast.list(color.b)[5] == NULL_AST_ID);
+		const AstNode &counter{ ast.decls[ast.file_decls[6]] };
+		assert(counter.b == NULL_AST_ID && counter.c != NULL_AST_ID);
+		const AstNode &printf_decl{ ast.decls[ast.file_decls[8]] };
+		assert((printf_decl.flags & AST_VARIADIC) && ast.list(printf_decl.b)[1] == NULL_AST_ID && ast.list(printf_decl.b)[2] == 1);
+
+		const AstNode &sum{ ast.decls[ast.file_decls[9]] };
+		const uint32_t *sum_info{ ast.list(sum.b) };
+		assert(sum_info[2] == 2 && std::strcmp(intern_str(sum_info[5]), "n") == 0);
+		const AstNode &body{ ast.stmts[sum_info[1]] };
+		const StmtKind stmt_kinds[]{ STMT_INIT, STMT_FOR, STMT_WHILE, STMT_DO_WHILE, STMT_IF, STMT_SWITCH, STMT_LABEL, STMT_DECL, STMT_RETURN };
+		assert(body.kind == STMT_BLOCK && body.b == sizeof(stmt_kinds) / sizeof(stmt_kinds[0]));
+		for (uint32_t i{ 0 }; i < body.b; ++i)
+		{
+			assert(ast.stmts[ast.list(body.a)[i]].kind == stmt_kinds[i]);
+		}
+
+		const uint32_t *for_parts{ ast.list(ast.stmts[ast.list(body.a)[1]].a) };
+		assert(ast.stmts[for_parts[0]].kind == STMT_INIT && expr_to_string(ast, for_parts[1]) == "(< i n)");
+		const AstNode &loop_body{ ast.stmts[for_parts[3]] };
+		const AstNode &assign{ ast.stmts[ast.list(loop_body.a)[0]] };
+		assert(assign.kind == STMT_ASSIGN && assign.op == Token::ADD_ASSIGN);
+		assert(expr_to_string(ast, assign.b) == "(* (field (index v i) x) (field (index v i) y))");
+
+		const AstNode &if_stmt{ ast.stmts[ast.list(body.a)[4]] };
+		const AstNode &else_if{ ast.stmts[if_stmt.c] };
+		assert(else_if.kind == STMT_IF && ast.stmts[else_if.b].kind == STMT_RETURN && ast.stmts[else_if.c].kind == STMT_BLOCK);
+
+		const AstNode &switch_stmt{ ast.stmts[ast.list(body.a)[5]] };
+		assert(switch_stmt.c == 2);
+		const AstNode &first_case{ ast.stmts[ast.list(switch_stmt.b)[0]] };
+		const AstNode &default_case{ ast.stmts[ast.list(switch_stmt.b)[1]] };
+		assert(first_case.b == 2 && ast.stmts[first_case.c].b == 2 && !(first_case.flags & AST_DEFAULT));
+		assert((default_case.flags & AST_DEFAULT) && ast.stmts[ast.list(ast.stmts[default_case.c].a)[0]].kind == STMT_JMP);
+	}
+
+	void bench_corpus_test()
+	{
+		init_keywords();
+		for (size_t mix{ 0 }; mix < NUM_CORPUS_MIXES; ++mix)
+		{
+			const std::string text{ generate_corpus(static_cast<CorpusMix>(mix), 4096, 42) };
+			assert(text.size() >= 4096);
+			assert(text == generate_corpus(static_cast<CorpusMix>(mix), 4096, 42));
+			assert(text != generate_corpus(static_cast<CorpusMix>(mix), 4096, 43));
+
+			// Every mix has to lex cleanly, so the suite measures the fast path and not error recovery
+			Lexer lexer;
+			lexer.init_stream("<corpus>", text.c_str());
+			size_t num_tokens{ 0 };
+			while (!lexer.is_token(Token::END_OF_FILE))
+			{
+				++num_tokens;
+				lexer.next_token();
+			}
+			assert(num_tokens > 0);
+		}
+
+		// Each mix gets an interner of its own, so a repeat measures the same and
+		// the process's interns come out of it untouched
+		const char *name{ str_intern("bench_corpus_test_name") };
+		const size_t num_interns{ interns.size() };
+		const LexBenchResult first{ bench_lex_corpus(CORPUS_IDENT, 4096, 42) };
+		const LexBenchResult second{ bench_lex_corpus(CORPUS_IDENT, 4096, 42) };
+		assert(first.num_intern_inserts > 0 && first.num_intern_inserts == second.num_intern_inserts);
+		assert(first.num_allocations == second.num_allocations);
+		assert(first.intern_memory == second.intern_memory);
+		assert(interns.size() == num_interns && str_intern("bench_corpus_test_name") == name);
+	}
+
+	void stats_test()
+	{
+	#if REVISION_STATS
+		init_keywords();
+		reset_stats();
+		const char *text{ "x = y + 1; x = x * 2;" };
+		Lexer lexer;
+		lexer.init_stream(nullptr, text);
+		while (!lexer.is_token(Token::END_OF_FILE))
+		{
+			lexer.next_token();
+		}
+		StatCounters stats{ total_stats() };
+		assert(stats.counters[STAT_BYTES_LEXED] == std::strlen(text));
+		assert(stats.token_kinds[Token::NAME] == 4 && stats.token_kinds[Token::INT] == 2);
+		assert(stats.token_kinds[Token::ASSIGN] == 2 && stats.token_kinds[Token::SEMICOLON] == 2 && stats.token_kinds[Token::END_OF_FILE] == 1);
+		assert(stats.counters[STAT_INTERN_LOOKUPS] + stats.counters[STAT_INTERN_INSERTS] == 4);
+
+		// Every worker counts into its own block, the total has to see all of them
+		reset_stats();
+		const size_t num_tasks{ 64 };
+		ThreadPool pool(4);
+		pool.parallel_for(num_tasks, [&](size_t, size_t)
+		{
+			Lexer worker_lexer;
+			worker_lexer.intern_range = str_intern_range_concurrent;
+			worker_lexer.init_stream(nullptr, text);
+			while (!worker_lexer.is_token(Token::END_OF_FILE))
+			{
+				worker_lexer.next_token();
+			}
+		});
+		stats = total_stats();
+		assert(stats.counters[STAT_BYTES_LEXED] == num_tasks * std::strlen(text));
+		assert(stats.token_kinds[Token::NAME] == num_tasks * 4);
+		uint64_t num_finds{ 0 };
+		for (uint64_t count : stats.intern_probe_histogram) { num_finds += count; }
+		assert(num_finds >= num_tasks * 4);
+
+		PhaseTimer timer{ PHASE_LEX };
+		timer.next(PHASE_REMAP);
+		timer.stop();
+		timer.stop();
+		assert(phase_times[PHASE_LEX].count == 1 && phase_times[PHASE_REMAP].count == 1);
+		assert(phase_times[PHASE_LEX].wall_seconds >= 0.0 && phase_times[PHASE_REMAP].cpu_seconds >= 0.0);
+		reset_stats();
+	#endif
+	}
+
+	static void assert_same_tokens(const TokenBuffer &a, const TokenBuffer &b)
+	{
+		assert(a.size() == b.size());
+		for (size_t i{ 0 }; i < a.size(); ++i)
+		{
+			const Token x{ a.token_at(i) };
+			const Token y{ b.token_at(i) };
+			assert(x.kind == y.kind && x.mod == y.mod);
+			assert(a.starts[i] == b.starts[i] && a.ends[i] == b.ends[i]);
+			// Literal payloads are side array indices and differ, the values must not
+			if (x.kind == Token::INT) { assert(x.int_val == y.int_val); }
+			else if (x.kind == Token::FLOAT) { assert(x.float_val == y.float_val); }
+			else { assert(x.name_id == y.name_id); }
+		}
+	}
+
+	void relex_test()
+	{
+		init_keywords();
+		Lexer lexer;
+		TokenBuffer buf;
+		TokenBuffer expected;
+		std::string text;
+		std::string next;
+		auto apply{ [&](size_t offset, size_t old_len, const char *replacement) {
+			next = text;
+			next.replace(offset, old_len, replacement);
+			const RelexResult result{ relex_edit(&lexer, &buf, next.c_str(),
+				TokenEdit{ static_cast<uint32_t>(offset), static_cast<uint32_t>(old_len), static_cast<uint32_t>(std::strlen(replacement)) }) };
+			// buf now points into next, text gets its own copy
+			text = next;
+			tokenize_all(&lexer, "relex", text.c_str(), &expected);
+			assert_same_tokens(buf, expected);
+			assert(buf.int_vals.size() == expected.int_vals.size() && buf.float_vals.size() == expected.float_vals.size());
+			return result;
+		} };
+
+		// Edits that open and close comments and strings, and so change how everything after them lexes
+		text = "a = \"one /* two\" + b; /* c \"d\" */ e = 1.5;\nf(g, 0x2);\n";
+		tokenize_all(&lexer, "relex", text.c_str(), &buf);
+		RelexResult result{ apply(4, 1, "") };
+		assert(buf.size() == 4 && buf.kinds[2] == Token::NAME);
+		apply(4, 0, "\"");
+		result = apply(0, 0, "/* ");
+		assert(result.first == 0 && buf.size() == 1);
+		apply(0, 3, "");
+		apply(text.find("*/"), 2, "/* */");
+		apply(text.find("e ="), 1, "e2");
+		apply(text.size(), 0, "h.x .5 ...");
+		apply(0, text.size(), "");
+		apply(0, 0, "x");
+
+		// A one token edit in a big file only relexes around the edit
+		text.clear();
+		for (int i{ 0 }; i < 1000; ++i)
+		{
+			text += "value_" + std::to_string(i) + " = value_" + std::to_string(i) + " * 2 + 0.5; /* /* nested */ */\n";
+		}
+		tokenize_all(&lexer, "relex", text.c_str(), &buf);
+		const size_t middle{ text.find("value_500 *") };
+		result = apply(middle + 6, 3, "5000");
+		assert(result.num_removed == 1 && result.num_inserted == 1 && buf.size() == expected.size());
+		// The tokens within RELEX_LOOKAHEAD in front of the edit come back unchanged
+		result = apply(middle, 0, "//");
+		assert(result.num_removed == result.num_inserted + 6 && result.num_inserted <= 2);
+
+		// Random edits without quotes, so no edit leaves a string running to the end of the line,
+		// and without the letters a-f, so digits and names running together stay quiet
+		const char *const pieces[]{ "/*", "*/", "//", "x", "zz9", " ", "\n", "1", "7.5", "+", "=", "+=", ".", "..", "(", "}" };
+		text = "x = 1; /* q /* r */ s */ y += x.z(7.5); // ok\nw";
+		tokenize_all(&lexer, "relex", text.c_str(), &buf);
+		uint32_t rng{ 7 };
+		for (int round{ 0 }; round < 2000; ++round)
+		{
+			rng = rng * 1664525 + 1013904223;
+			const size_t offset{ (rng >> 8) % (text.size() + 1) };
+			const size_t old_len{ std::min<size_t>((rng >> 4) % 4, text.size() - offset) };
+			apply(offset, (rng & 1) ? old_len : 0, pieces[(rng >> 20) % (sizeof(pieces) / sizeof(pieces[0]))]);
+		}
+	}
+
+	void token_cache_test()
+	{
+		assert(xxhash64("", 0, 0) == 0xEF46DB3751D8E999ull);
+		assert(xxhash64("abc", 3, 0) == 0x44BC2CF5AD770999ull);
+		const std::string long_text(1000, 'x');
+		assert(xxhash64(long_text.data(), long_text.size(), 0) != xxhash64(long_text.data(), long_text.size() - 1, 0));
+
+		init_keywords();
+		const char *dir{ "revision_token_cache_test.tmp" };
+		assert(make_token_cache_dir(dir) && make_token_cache_dir(dir));
+		const std::string text{ "func f(x: int): float { return x * 2.5 + 0x10; } // done\ns := \"a\\0b\";\n" };
+		const uint64_t hash{ xxhash64(text.data(), text.size(), 0) };
+		const std::string path{ token_cache_path(dir, hash) };
+		Lexer lexer;
+		TokenBuffer buf;
+		tokenize_all(&lexer, "cached", text.c_str(), &buf);
+		assert(save_token_cache(path.c_str(), buf, hash));
+
+		TokenBuffer loaded;
+		assert(load_token_cache(path.c_str(), "cached", text.c_str(), text.size(), hash, str_intern_range, &loaded));
+		assert_same_tokens(buf, loaded);
+		assert(resolve_pos(loaded.token_at(3).pos).col == 8);
+
+		// Other content, a stale format or a damaged file are all just misses
+		assert(!load_token_cache(path.c_str(), "cached", text.c_str(), text.size(), hash + 1, str_intern_range, &loaded));
+		assert(!load_token_cache((path + ".missing").c_str(), "cached", text.c_str(), text.size(), hash, str_intern_range, &loaded));
+		size_t len;
+		char *bytes{ read_file(path.c_str(), &len) };
+		const std::string damaged_path{ path + ".damaged" };
+		assert(write_file(damaged_path.c_str(), bytes, len - 1));
+		assert(!load_token_cache(damaged_path.c_str(), "cached", text.c_str(), text.size(), hash, str_intern_range, &loaded));
+		reinterpret_cast<TokenCacheHeader *>(bytes)->version = TOKEN_CACHE_VERSION + 1;
+		assert(write_file(damaged_path.c_str(), bytes, len));
+		assert(!load_token_cache(damaged_path.c_str(), "cached", text.c_str(), text.size(), hash, str_intern_range, &loaded));
+		// A value changed in place, as by a torn write, fails the body hash
+		reinterpret_cast<TokenCacheHeader *>(bytes)->version = TOKEN_CACHE_VERSION;
+		const TokenCacheHeader header{ *reinterpret_cast<const TokenCacheHeader *>(bytes) };
+		assert(header.num_float_vals > 0);
+		const size_t floats_offset{ sizeof(TokenCacheHeader) + header.num_int_vals * sizeof(uint64_t) };
+		bytes[floats_offset] ^= 1;
+		assert(write_file(damaged_path.c_str(), bytes, len));
+		assert(!load_token_cache(damaged_path.c_str(), "cached", text.c_str(), text.size(), hash, str_intern_range, &loaded));
+		bytes[floats_offset] ^= 1;
+		// A token past the end of the text, even with a matching body hash, is caught before any name is interned
+		const size_t ends_offset{ sizeof(TokenCacheHeader) + (header.num_int_vals + header.num_float_vals) * sizeof(uint64_t) + header.num_tokens * sizeof(uint32_t) };
+		const uint32_t past_end{ static_cast<uint32_t>(text.size() + 1) };
+		std::memcpy(bytes + ends_offset, &past_end, sizeof(past_end));
+		reinterpret_cast<TokenCacheHeader *>(bytes)->body_hash = xxhash64(bytes + sizeof(TokenCacheHeader), len - sizeof(TokenCacheHeader), 0);
+		assert(write_file(damaged_path.c_str(), bytes, len));
+		static int num_interned;
+		num_interned = 0;
+		const char *(*count_intern)(const char *, const char *, InternId *) = [](const char *start, const char *end, InternId *id)
+		{
+			++num_interned;
+			return str_intern_range(start, end, id);
+		};
+		assert(!load_token_cache(damaged_path.c_str(), "cached", text.c_str(), text.size(), hash, count_intern, &loaded));
+		assert(num_interned == 0);
+		std::free(bytes);
+		std::remove(damaged_path.c_str());
+		std::remove(path.c_str());
+
+		// A warm run through the driver loads every file and gets the same tokens
+		std::vector<std::string> texts;
+		for (int i{ 0 }; i < 8; ++i)
+		{
+			texts.push_back("cache_file" + std::to_string(i) + " := " + std::to_string(i) + ".5; s := \"str\";\n");
+		}
+		std::vector<SourceFile> cold;
+		std::vector<SourceFile> warm;
+		for (const std::string &file_text : texts)
+		{
+			cold.push_back(SourceFile{ "cold", file_text.c_str(), file_text.size(), {}, {} });
+			warm.push_back(SourceFile{ "warm", file_text.c_str(), file_text.size(), {}, {} });
+		}
+		assert(lex_files(cold, 4, dir).num_cached == 0);
+		assert(lex_files(warm, 4, dir).num_cached == texts.size());
+		for (size_t i{ 0 }; i < texts.size(); ++i)
+		{
+			assert_same_tokens(cold[i].tokens, warm[i].tokens);
+			std::remove(token_cache_path(dir, xxhash64(texts[i].data(), texts[i].size(), 0)).c_str());
+		}
+		std::remove(dir);
+	}
+
+	void diag_test()
+	{
+		// What earlier tests reported goes out first
+		flush_diags(stdout);
+		assert(take_diags().empty());
+		const size_t max_errors{ diag_max_errors };
+
+		// Sorted by file and offset, not by the order they were reported in
+		LineTable b_lines;
+		b_lines.init("b", "x\ny z\n");
+		LineTable a_lines;
+		a_lines.init("a", "q");
+		error(SrcPos{ &b_lines, 4 }, "second %d", 2);
+		warning(SrcPos{ &b_lines, 0 }, "first");
+		error(SrcPos{ &a_lines, 0 }, "%s", "other file");
+		syntax_error("no position %s", "here");
+		assert(take_diags() == "error: no position here\na(1,1): error: other file\nb(1,1): warning: first\nb(2,3): error: second 2\n");
+		assert(take_diags().empty());
+
+		// Past the cap errors are only counted
+		diag_max_errors = 3;
+		for (int i{ 0 }; i < 10; ++i)
+		{
+			error(SrcPos{ &b_lines, 0 }, "capped %d", i);
+		}
+		warning(SrcPos{ &b_lines, 0 }, "not capped");
+		assert(take_diags() == "b(1,1): error: capped 0\nb(1,1): error: capped 1\nb(1,1): error: capped 2\nb(1,1): warning: not capped\n7 more errors not shown\n");
+
+		// Reported from several threads, flushed in file order
+		diag_max_errors = 0;
+		const size_t num_files{ 16 };
+		ThreadPool pool(4);
+		pool.parallel_for(num_files, [&](size_t, size_t task)
+		{
+			char name[16];
+			std::snprintf(name, sizeof(name), "file%02zu", task);
+			LineTable lines;
+			lines.init(name, "ab\ncd");
+			error(SrcPos{ &lines, 3 }, "late");
+			error(SrcPos{ &lines, 0 }, "early");
+		});
+		std::string expected;
+		for (size_t i{ 0 }; i < num_files; ++i)
+		{
+			char name[16];
+			std::snprintf(name, sizeof(name), "file%02zu", i);
+			expected += std::string{ name } + "(1,1): error: early\n" + name + "(2,1): error: late\n";
+		}
+		assert(take_diags() == expected);
+		diag_max_errors = max_errors;
+	}
+
+	// Hands out at most max_read bytes per read, to also cover short reads
+	struct MemoryStream
+	{
+		const char *text;
+		size_t len;
+		size_t pos;
+		size_t max_read;
+	};
+	static size_t read_memory_stream(void *user, char *dst, size_t max_len)
+	{
+		MemoryStream *source{ static_cast<MemoryStream *>(user) };
+		const size_t n{ std::min({ max_len, source->max_read, source->len - source->pos }) };
+		std::memcpy(dst, source->text + source->pos, n);
+		source->pos += n;
+		return n;
+	}
+
+	void stream_lex_test()
+	{
+		init_keywords();
+		flush_diags(stdout);
+
+		// Tokens, comments and errors cut at every possible place by the chunk sizes below
+		std::string text;
+		for (int i{ 0 }; i < 40; ++i)
+		{
+			text += "name" + std::to_string(i) + " := " + std::to_string(i * 37) + ".25e1 + 0x" + std::to_string(i) + "f; ";
+			text += "/* block /* nested " + std::to_string(i) + " */ still */ s = \"short\\n str\" ... a<<=b // line comment\n";
+			text += "0b12 x = 'c'; $ /* after an invalid char */ `\n";
+			if (i % 10 == 0)
+			{
+				text += "\"" + std::string(300, 'L') + "\" /*" + std::string(500, '*') + "*/\n";
+			}
+		}
+		TokenBuffer expected;
+		Lexer lexer;
+		tokenize_all(&lexer, "stream", text.c_str(), &expected);
+		const std::string expected_diags{ take_diags() };
+		assert(!expected_diags.empty());
+		const size_t num_interns{ interns.size() };
+
+		for (size_t chunk_size : { 16, 17, 23, 64, 1000, STREAM_DEFAULT_CHUNK_SIZE })
+		{
+			for (size_t max_read : { chunk_size, size_t{ 5 } })
+			{
+				reset_stats();
+				MemoryStream source{ text.c_str(), text.size(), 0, max_read };
+				StreamLexer stream;
+				stream.init("stream", read_memory_stream, &source, chunk_size);
+				for (size_t i{ 0 }; i < expected.size(); ++i)
+				{
+					const Token x{ expected.token_at(i) };
+					const Token &y{ stream.lexer.token };
+					assert(x.kind == y.kind && x.mod == y.mod);
+					assert(stream.token_offset() == expected.starts[i] && y.end - y.start == x.end - x.start);
+					if (x.kind == Token::INT) { assert(x.int_val == y.int_val); }
+					else if (x.kind == Token::FLOAT) { assert(x.float_val == y.float_val); }
+					else if (x.kind == Token::NAME || x.kind == Token::KEYWORD || x.kind == Token::STR) { assert(x.name_id == y.name_id); }
+					stream.next_token();
+				}
+				assert(stream.lexer.token.kind == Token::END_OF_FILE);
+				// Errors in tokens lexed twice are reported once, at their place in the whole input
+				assert(take_diags() == expected_diags);
+				// and names cut by a chunk boundary were never interned
+				assert(interns.size() == num_interns);
+			#if REVISION_STATS
+				// Stats count every byte and token once, END_OF_FILE included, as the whole-buffer lexer does
+				const StatCounters stats{ total_stats() };
+				uint64_t num_tokens{ 0 };
+				for (uint64_t count : stats.token_kinds) { num_tokens += count; }
+				assert(stats.counters[STAT_BYTES_LEXED] == text.size() && num_tokens == expected.size() + 1);
+			#endif
+			}
+		}
+
+		// Comments never have to fit in the buffer, only tokens do
+		text = "start /*" + std::string(100000, ' ') + "/* */ */ // " + std::string(100000, '/') + "\nend";
+		MemoryStream source{ text.c_str(), text.size(), 0, text.size() };
+		StreamLexer stream;
+		stream.init("stream", read_memory_stream, &source, 256);
+		assert(stream.lexer.token.kind == Token::NAME && stream.token_offset() == 0);
+		stream.next_token();
+		assert(stream.lexer.token.kind == Token::NAME && stream.token_offset() == text.size() - 3);
+		stream.next_token();
+		assert(stream.lexer.token.kind == Token::END_OF_FILE);
+		assert(stream.buf.size() == 2 * 256 + 1);
+		assert(take_diags().empty());
+
+		// Nor do comments right after an invalid char
+		text = "x $ /*" + std::string(200000, ' ') + "*/ y";
+		source = MemoryStream{ text.c_str(), text.size(), 0, text.size() };
+		stream.init("stream", read_memory_stream, &source, 256);
+		assert(stream.lexer.token.kind == Token::NAME && stream.token_offset() == 0);
+		stream.next_token();
+		assert(stream.lexer.token.kind == Token::NAME && stream.token_offset() == text.size() - 1);
+		assert(stream.buf.size() == 2 * 256 + 1);
+		assert(take_diags() == "stream(1,3): error: Invalid '$' token, skipping\n");
+	}
+
+	// Runs first, so nothing has seeded interns yet
+	void lex_before_init_test()
+	{
+		Lexer lexer;
+		lexer.init_stream("t", "if x");
+		assert(lexer.token.kind == Token::KEYWORD && std::strcmp(lexer.token.name, "if") == 0);
+		assert(lexer.token.name_id == if_keyword_id && intern_id_of(lexer.token.name) == if_keyword_id);
+		lexer.next_token();
+		assert(lexer.token.kind == Token::NAME && std::strcmp(lexer.token.name, "x") == 0);
+	}
+
 	void run_all_tests()
 	{
+		lex_before_init_test();
+		arena_test();
 		str_intern_test();
+		concurrent_intern_test();
 		keyword_test();
 		lex_test();
+		float_literal_test();
+		int_literal_test();
+		scan_kernels_test();
+		token_buffer_test();
+		driver_test();
+		source_map_test();
+		ast_test();
+		parse_expr_test();
+		parse_file_test();
+		bench_corpus_test();
+		stats_test();
+		relex_test();
+		token_cache_test();
+		diag_test();
+		stream_lex_test();
 	}
 }
\ No newline at end of file
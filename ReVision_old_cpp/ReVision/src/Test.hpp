@@ -1,13 +1,39 @@
 #pragma once
+#include "Ast.hpp"
+#include "Bench.hpp"
 #include "Common.hpp"
+#include "Diag.hpp"
+#include "Driver.hpp"
+#include "Float.hpp"
 #include "Lex.hpp"
+#include "Parse.hpp"
+#include "Stats.hpp"
+#include "StreamLex.hpp"
+#include "TokenCache.hpp"
 
 namespace ReVision
 {
+	void arena_test();
 	void str_intern_test();
+	void concurrent_intern_test();
 
 	void keyword_test();
 	void lex_test();
+	void float_literal_test();
+	void int_literal_test();
+	void scan_kernels_test();
+	void token_buffer_test();
+	void driver_test();
+	void source_map_test();
+	void ast_test();
+	void parse_expr_test();
+	void parse_file_test();
+	void bench_corpus_test();
+	void stats_test();
+	void relex_test();
+	void token_cache_test();
+	void diag_test();
+	void stream_lex_test();
 
 	void run_all_tests();
 }
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "ThreadPool.hpp"
+
+namespace ReVision
+{
+	size_t default_thread_count()
+	{
+		const unsigned int n{ std::thread::hardware_concurrency() };
+		return n ? n : 1;
+	}
+
+	ThreadPool::ThreadPool(size_t num_threads)
+		: num_threads(num_threads ? num_threads : default_thread_count())
+	{
+		for (size_t i{ 0 }; i < this->num_threads; ++i)
+		{
+			queues.push_back(std::make_unique<WorkQueue>());
+		}
+	}
+
+	bool ThreadPool::pop_task(size_t worker, size_t *task)
+	{
+		{
+			WorkQueue &own{ *queues[worker] };
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				*task = own.tasks.back();
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (size_t i{ 1 }; i < num_threads; ++i)
+		{
+			WorkQueue &victim{ *queues[(worker + i) % num_threads] };
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				*task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void ThreadPool::parallel_for(size_t num_tasks, const std::function<void(size_t worker, size_t task)> &task)
+	{
+		// Push in reverse so every worker starts with the lowest index it owns.
+		for (size_t i{ num_tasks }; i-- > 0;)
+		{
+			queues[i % num_threads]->tasks.push_back(i);
+		}
+
+		// No task ever enqueues new work, so an empty sweep over all queues means this worker is done.
+		auto worker_main = [&](size_t worker)
+		{
+			size_t index;
+			while (pop_task(worker, &index))
+			{
+				task(worker, index);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (size_t i{ 1 }; i < num_threads; ++i)
+		{
+			threads.emplace_back(worker_main, i);
+		}
+		worker_main(0);
+		for (std::thread &t : threads)
+		{
+			t.join();
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "Common.hpp"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <thread>
+
+namespace ReVision
+{
+	// Every worker owns a deque of task indices. It pops from the back of its
+	// own deque and, once that runs dry, steals from the front of the others.
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<size_t> tasks;
+	};
+
+	struct ThreadPool
+	{
+		explicit ThreadPool(size_t num_threads = 0);
+
+		// Runs task(i) for every i in [0, num_tasks) and returns once all of them are done.
+		// Tasks are handed out round-robin in index order, so put the expensive ones first.
+		void parallel_for(size_t num_tasks, const std::function<void(size_t worker, size_t task)> &task);
+
+		size_t num_threads;
+	private:
+		bool pop_task(size_t worker, size_t *task);
+
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+	};
+
+	size_t default_thread_count();
+}
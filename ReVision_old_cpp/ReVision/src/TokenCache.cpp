@@ -0,0 +1,241 @@
+#include "TokenCache.hpp"
+#include "Source.hpp"
+
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ReVision
+{
+	std::string token_cache_path(const char *dir, uint64_t content_hash)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "/%016" PRIx64 ".tok", content_hash);
+		return std::string(dir) + name;
+	}
+
+	bool make_token_cache_dir(const char *dir)
+	{
+	#ifdef _WIN32
+		return CreateDirectoryA(dir, nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+	#else
+		struct stat info;
+		return mkdir(dir, 0777) == 0 || (stat(dir, &info) == 0 && S_ISDIR(info.st_mode));
+	#endif
+	}
+
+	template<typename T>
+	static void append_array(std::vector<char> *blob, const T *data, size_t count)
+	{
+		const char *bytes{ reinterpret_cast<const char *>(data) };
+		blob->insert(blob->end(), bytes, bytes + count * sizeof(T));
+	}
+
+	static bool is_name_kind(uint8_t kind)
+	{
+		return kind == Token::NAME || kind == Token::KEYWORD || kind == Token::STR;
+	}
+
+	bool save_token_cache(const char *path, const TokenBuffer &buf, uint64_t content_hash)
+	{
+		const size_t num_tokens{ buf.size() };
+		assert(num_tokens > 0 && buf.kinds.back() == Token::END_OF_FILE);
+
+		// Number the names in order of first use
+		std::unordered_map<InternId, uint32_t> local_ids;
+		std::vector<uint32_t> payloads(buf.payloads);
+		std::vector<uint32_t> name_offsets{ 0 };
+		std::string name_bytes;
+		for (size_t i{ 0 }; i < num_tokens; ++i)
+		{
+			if (!is_name_kind(buf.kinds[i]))
+			{
+				continue;
+			}
+			const InternId id{ buf.payloads[i] };
+			assert(!is_provisional_intern_id(id));
+			const auto found{ local_ids.emplace(id, static_cast<uint32_t>(local_ids.size())) };
+			if (found.second)
+			{
+				name_bytes.append(intern_str(id), intern_len(id));
+				name_offsets.push_back(static_cast<uint32_t>(name_bytes.size()));
+			}
+			payloads[i] = found.first->second;
+		}
+
+		TokenCacheHeader header{};
+		std::memcpy(header.magic, TOKEN_CACHE_MAGIC, sizeof(header.magic));
+		header.version = TOKEN_CACHE_VERSION;
+		header.num_token_kinds = Token::NUM_TOKEN_KINDS;
+		header.num_keywords = NUM_KEYWORDS;
+		header.num_tokens = static_cast<uint32_t>(num_tokens);
+		header.content_hash = content_hash;
+		header.content_len = buf.ends.back();
+		header.num_int_vals = static_cast<uint32_t>(buf.int_vals.size());
+		header.num_float_vals = static_cast<uint32_t>(buf.float_vals.size());
+		header.num_names = static_cast<uint32_t>(local_ids.size());
+		header.name_bytes = static_cast<uint32_t>(name_bytes.size());
+
+		std::vector<char> blob;
+		append_array(&blob, &header, 1);
+		append_array(&blob, buf.int_vals.data(), buf.int_vals.size());
+		append_array(&blob, buf.float_vals.data(), buf.float_vals.size());
+		append_array(&blob, buf.starts.data(), num_tokens);
+		append_array(&blob, buf.ends.data(), num_tokens);
+		append_array(&blob, payloads.data(), num_tokens);
+		append_array(&blob, name_offsets.data(), name_offsets.size());
+		append_array(&blob, buf.kinds.data(), num_tokens);
+		append_array(&blob, buf.mods.data(), num_tokens);
+		append_array(&blob, name_bytes.data(), name_bytes.size());
+		header.body_hash = xxhash64(blob.data() + sizeof(header), blob.size() - sizeof(header), 0);
+		std::memcpy(blob.data(), &header, sizeof(header));
+
+		// Named after the process and thread so concurrent writers, in this process or others
+		// sharing the cache dir, each write their own file. Whichever rename lands last wins,
+		// and the content is the same either way.
+	#ifdef _WIN32
+		const unsigned long process_id{ GetCurrentProcessId() };
+	#else
+		const unsigned long process_id{ static_cast<unsigned long>(getpid()) };
+	#endif
+		const std::string temp_path{ std::string(path) + "." + std::to_string(process_id) + "."
+			+ std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp" };
+		if (!write_file(temp_path.c_str(), blob.data(), blob.size()))
+		{
+			std::remove(temp_path.c_str());
+			return false;
+		}
+	#ifdef _WIN32
+		if (!MoveFileExA(temp_path.c_str(), path, MOVEFILE_REPLACE_EXISTING))
+	#else
+		if (std::rename(temp_path.c_str(), path) != 0)
+	#endif
+		{
+			std::remove(temp_path.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Walks the sections of a mapped cache file, failing instead of reading past its end.
+	struct TokenCacheReader
+	{
+		const char *ptr;
+		const char *end;
+
+		template<typename T>
+		const T *take(size_t count)
+		{
+			if (count > static_cast<size_t>(end - ptr) / sizeof(T))
+			{
+				return nullptr;
+			}
+			const T *data{ reinterpret_cast<const T *>(ptr) };
+			ptr += count * sizeof(T);
+			return data;
+		}
+	};
+
+	static bool load_mapped_token_cache(const SourceMap &map, const char *name, const char *text, size_t len, uint64_t content_hash,
+		const char *(*intern_range)(const char *start, const char *end, InternId *id), TokenBuffer *buf)
+	{
+		TokenCacheReader reader{ map.text, map.text + map.len };
+		const TokenCacheHeader *header{ reader.take<TokenCacheHeader>(1) };
+		if (!header || std::memcmp(header->magic, TOKEN_CACHE_MAGIC, sizeof(header->magic)) != 0
+			|| header->version != TOKEN_CACHE_VERSION || header->num_token_kinds != Token::NUM_TOKEN_KINDS
+			|| header->num_keywords != NUM_KEYWORDS || header->content_hash != content_hash
+			|| header->content_len != len || header->num_tokens == 0)
+		{
+			return false;
+		}
+		const size_t num_tokens{ header->num_tokens };
+		const uint64_t *int_vals{ reader.take<uint64_t>(header->num_int_vals) };
+		const double *float_vals{ reader.take<double>(header->num_float_vals) };
+		const uint32_t *starts{ reader.take<uint32_t>(num_tokens) };
+		const uint32_t *ends{ reader.take<uint32_t>(num_tokens) };
+		const uint32_t *payloads{ reader.take<uint32_t>(num_tokens) };
+		const uint32_t *name_offsets{ reader.take<uint32_t>(static_cast<size_t>(header->num_names) + 1) };
+		const uint8_t *kinds{ reader.take<uint8_t>(num_tokens) };
+		const uint8_t *mods{ reader.take<uint8_t>(num_tokens) };
+		const char *name_bytes{ reader.take<char>(header->name_bytes) };
+		if (!name_bytes || reader.ptr != reader.end || kinds[num_tokens - 1] != Token::END_OF_FILE
+			|| xxhash64(map.text + sizeof(TokenCacheHeader), map.len - sizeof(TokenCacheHeader), 0) != header->body_hash)
+		{
+			return false;
+		}
+
+		// Everything is checked before anything is interned, so a corrupt file leaves no names behind
+		for (uint32_t i{ 0 }; i < header->num_names; ++i)
+		{
+			if (name_offsets[i] > name_offsets[i + 1] || name_offsets[i + 1] > header->name_bytes)
+			{
+				return false;
+			}
+		}
+		for (size_t i{ 0 }; i < num_tokens; ++i)
+		{
+			const uint32_t payload{ payloads[i] };
+			bool ok{ kinds[i] < Token::NUM_TOKEN_KINDS && starts[i] <= ends[i] && ends[i] <= len };
+			switch (kinds[i])
+			{
+			case Token::NAME: case Token::KEYWORD: case Token::STR: ok = ok && payload < header->num_names; break;
+			case Token::INT: ok = ok && payload < header->num_int_vals; break;
+			case Token::FLOAT: ok = ok && payload < header->num_float_vals; break;
+			default: break;
+			}
+			if (!ok)
+			{
+				return false;
+			}
+		}
+
+		// One batch of interns for the whole name table
+		std::vector<InternId> ids(header->num_names);
+		for (uint32_t i{ 0 }; i < header->num_names; ++i)
+		{
+			intern_range(name_bytes + name_offsets[i], name_bytes + name_offsets[i + 1], &ids[i]);
+		}
+
+		buf->clear();
+		buf->name = name;
+		buf->text = text;
+		buf->lines.init(name, text);
+		buf->kinds.assign(kinds, kinds + num_tokens);
+		buf->mods.assign(mods, mods + num_tokens);
+		buf->starts.assign(starts, starts + num_tokens);
+		buf->ends.assign(ends, ends + num_tokens);
+		buf->payloads.assign(payloads, payloads + num_tokens);
+		buf->int_vals.assign(int_vals, int_vals + header->num_int_vals);
+		buf->float_vals.assign(float_vals, float_vals + header->num_float_vals);
+		for (size_t i{ 0 }; i < num_tokens; ++i)
+		{
+			if (kinds[i] == Token::NAME || kinds[i] == Token::KEYWORD || kinds[i] == Token::STR)
+			{
+				buf->payloads[i] = ids[payloads[i]];
+			}
+		}
+		return true;
+	}
+
+	bool load_token_cache(const char *path, const char *name, const char *text, size_t len, uint64_t content_hash,
+		const char *(*intern_range)(const char *start, const char *end, InternId *id), TokenBuffer *buf)
+	{
+		SourceMap map;
+		if (!source_map(&map, path))
+		{
+			return false;
+		}
+		const bool ok{ load_mapped_token_cache(map, name, text, len, content_hash, intern_range, buf) };
+		source_unmap(&map);
+		return ok;
+	}
+}
\ No newline at end of file
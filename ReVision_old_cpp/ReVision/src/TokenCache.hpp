@@ -0,0 +1,48 @@
+#pragma once
+#include "Lex.hpp"
+
+namespace ReVision
+{
+	// A cache file holds one text's TokenBuffer, keyed by the xxhash64 of the text, so
+	// unchanged files skip next_token on the next build. The layout is pointer free:
+	// the header, then int_vals, float_vals, starts, ends, payloads, name_offsets,
+	// kinds, mods and finally the name bytes. Names are numbered per file, the payload
+	// of a NAME, KEYWORD or STR token indexes name_offsets, and name i spans
+	// name_offsets[i] to name_offsets[i + 1], STR contents may hold '\0'.
+	// Every field is in host byte order, a big endian host just never gets a hit.
+	// The xxhash64 of everything after the header is checked before the file is used,
+	// so a torn write or an edited file is a miss rather than wrong tokens.
+	#define TOKEN_CACHE_MAGIC "RVTOKEN"
+	#define TOKEN_CACHE_VERSION 2
+
+	struct TokenCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		// A lexer with other token kinds or keywords makes every cache file stale
+		uint32_t num_token_kinds;
+		uint32_t num_keywords;
+		uint32_t num_tokens;
+		uint64_t content_hash;
+		uint64_t content_len;
+		uint64_t body_hash;
+		uint32_t num_int_vals;
+		uint32_t num_float_vals;
+		uint32_t num_names;
+		uint32_t name_bytes;
+	};
+	static_assert(sizeof(TokenCacheHeader) % 8 == 0, "the 8 byte arrays follow the header");
+
+	// dir/<16 hex digits of the hash>.tok
+	std::string token_cache_path(const char *dir, uint64_t content_hash);
+	// Creates dir if it doesn't exist yet.
+	bool make_token_cache_dir(const char *dir);
+
+	// Writes buf, whose names must have final ids, next to path and renames it into
+	// place, so concurrent builds never see half a file.
+	bool save_token_cache(const char *path, const TokenBuffer &buf, uint64_t content_hash);
+	// Maps the cache file and fills buf, interning the file's name table through
+	// intern_range. Fails for a missing, stale or damaged file, which just means a miss.
+	bool load_token_cache(const char *path, const char *name, const char *text, size_t len, uint64_t content_hash,
+		const char *(*intern_range)(const char *start, const char *end, InternId *id), TokenBuffer *buf);
+}
\ No newline at end of file
@@ -1,10 +1,16 @@
+#include "Driver.hpp"
 #include "Lex.hpp"
 #include "Test.hpp"
 
-int main()
+int main(int argc, char **argv)
 {
+	if (argc > 1)
+	{
+		return ReVision::driver_main(argc, argv);
+	}
+
 	ReVision::run_all_tests();
 
 	system("pause");
 	return 0;
-}
\ No newline at end of file
+}